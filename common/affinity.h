@@ -0,0 +1,260 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Thread placement for the OpenMP drivers. MATRIX_AFFINITY selects the policy:
+//  - compact: consecutive threads on the hardware threads of one core, then the next core, one package after the other
+//  - scatter: consecutive threads on different packages, then different cores, hyperthread siblings last
+//  - an explicit CPU list such as 0,2,4-7 (thread t gets the t-th CPU, wrapping around)
+// The topology (package, core and NUMA node of every CPU) is read from sysfs; only the CPUs of the process affinity
+// mask are used. The raw system calls take the masks as arrays of longs and need no _GNU_SOURCE.
+
+#define AFFINITY_MAX_CPUS 1024
+
+enum { AFFINITY_MASK_WORDS = AFFINITY_MAX_CPUS / (8 * sizeof(unsigned long)), AFFINITY_WORD_BITS = 8 * sizeof(unsigned long) };
+
+typedef struct {
+    int cpu;
+    int package, core, node;
+    int smt; // rank among the hardware threads of its core
+} CpuInfo;
+
+typedef struct {
+    int count;
+    CpuInfo cpus[AFFINITY_MAX_CPUS];
+    int packages, cores, nodes;
+} Topology;
+
+// CPU chosen for every thread by the active policy, none (count 0) when MATRIX_AFFINITY is not set
+static int affinityCpus[AFFINITY_MAX_CPUS];
+static int affinityCount = 0;
+
+// CPUs in the affinity mask of the calling thread, 0 if unknown (pid 0 is the calling thread)
+static inline int affinityAllowed(unsigned long *allowed) {
+    memset(allowed, 0, AFFINITY_MASK_WORDS * sizeof(unsigned long));
+    if (syscall(SYS_sched_getaffinity, 0, AFFINITY_MASK_WORDS * sizeof(unsigned long), allowed) <= 0) return 0;
+
+    int count = 0;
+    for (int w = 0; w < AFFINITY_MASK_WORDS; w++) count += __builtin_popcountl(allowed[w]);
+    return count;
+}
+
+static inline int affinityIsSet(const unsigned long *mask, int cpu) {
+    return (mask[cpu / AFFINITY_WORD_BITS] >> (cpu % AFFINITY_WORD_BITS)) & 1;
+}
+
+static inline int affinityPinSelf(int cpu) {
+    unsigned long mask[AFFINITY_MASK_WORDS] = {0};
+    if (cpu < 0 || cpu >= AFFINITY_MAX_CPUS) return 0;
+    mask[cpu / AFFINITY_WORD_BITS] = 1UL << (cpu % AFFINITY_WORD_BITS);
+    return syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask) == 0;
+}
+
+// CPU the calling thread is running on
+static inline int affinityCurrentCPU(void) {
+    unsigned int cpu = 0, node = 0;
+    syscall(SYS_getcpu, &cpu, &node, NULL);
+    return (int)cpu;
+}
+
+// Parses a CPU list (0,2,4-7, the sysfs cpulist format) into cpus; returns the number of CPUs
+static inline int parseCpuList(const char *list, int *cpus, int max) {
+    int count = 0;
+    while (*list != '\0' && count < max) {
+        char *end;
+        long first = strtol(list, &end, 10), last = first;
+        if (end == list) break;
+        if (*end == '-') last = strtol(end + 1, &end, 10);
+        for (long cpu = first; cpu <= last && count < max; cpu++) cpus[count++] = (int)cpu;
+        list = *end == ',' ? end + 1 : end;
+        if (*list == '\n') break;
+    }
+    return count;
+}
+
+static inline int readSysfsInt(const char *path, int fallback) {
+    FILE *file = fopen(path, "r");
+    int value = fallback;
+    if (file != NULL) {
+        if (fscanf(file, "%d", &value) != 1) value = fallback;
+        fclose(file);
+    }
+    return value;
+}
+
+// Package, core and NUMA node of every allowed CPU
+static inline void topologyDetect(Topology *topo) {
+    unsigned long allowed[AFFINITY_MASK_WORDS];
+    char path[128];
+
+    topo->count = 0;
+    if (affinityAllowed(allowed) == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        for (int cpu = 0; cpu < online && cpu < AFFINITY_MAX_CPUS; cpu++) allowed[cpu / AFFINITY_WORD_BITS] |= 1UL << (cpu % AFFINITY_WORD_BITS);
+    }
+    for (int cpu = 0; cpu < AFFINITY_MAX_CPUS; cpu++) {
+        if (!affinityIsSet(allowed, cpu)) continue;
+        CpuInfo *c = &topo->cpus[topo->count++];
+        c->cpu = cpu;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+        c->package = readSysfsInt(path, 0);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+        c->core = readSysfsInt(path, cpu);
+        c->node = 0;
+        c->smt = 0;
+        for (int k = 0; k < topo->count - 1; k++) {
+            if (topo->cpus[k].package == c->package && topo->cpus[k].core == c->core) c->smt++;
+        }
+    }
+
+    // NUMA nodes list their CPUs
+    int nodeCpus[AFFINITY_MAX_CPUS];
+    topo->nodes = 0;
+    for (int node = 0; node < 64; node++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *file = fopen(path, "r");
+        if (file == NULL) continue;
+        char list[1024] = "";
+        if (fgets(list, sizeof(list), file) != NULL) {
+            int count = parseCpuList(list, nodeCpus, AFFINITY_MAX_CPUS);
+            for (int k = 0; k < count; k++) {
+                for (int c = 0; c < topo->count; c++) {
+                    if (topo->cpus[c].cpu == nodeCpus[k]) topo->cpus[c].node = node;
+                }
+            }
+        }
+        fclose(file);
+        topo->nodes++;
+    }
+    if (topo->nodes == 0) topo->nodes = 1;
+
+    topo->packages = topo->cores = 0;
+    for (int c = 0; c < topo->count; c++) {
+        int newPackage = 1;
+        for (int k = 0; k < c; k++) {
+            if (topo->cpus[k].package == topo->cpus[c].package) newPackage = 0;
+        }
+        topo->packages += newPackage;
+        topo->cores += topo->cpus[c].smt == 0;
+    }
+}
+
+static inline int compareCompact(const void *a, const void *b) {
+    const CpuInfo *x = (const CpuInfo *)a, *y = (const CpuInfo *)b;
+    if (x->package != y->package) return x->package - y->package;
+    if (x->core != y->core) return x->core - y->core;
+    return x->smt - y->smt;
+}
+
+static inline int compareScatter(const void *a, const void *b) {
+    const CpuInfo *x = (const CpuInfo *)a, *y = (const CpuInfo *)b;
+    if (x->smt != y->smt) return x->smt - y->smt;
+    if (x->core != y->core) return x->core - y->core;
+    return x->package - y->package;
+}
+
+static inline const CpuInfo *topologyFind(const Topology *topo, int cpu) {
+    for (int c = 0; c < topo->count; c++) {
+        if (topo->cpus[c].cpu == cpu) return &topo->cpus[c];
+    }
+    return NULL;
+}
+
+// Fills affinityCpus for n_threads threads from MATRIX_AFFINITY; returns 0 when it is not set (no pinning)
+static inline int affinityPlan(const Topology *topo, int n_threads) {
+    const char *policy = getenv("MATRIX_AFFINITY");
+    affinityCount = 0;
+    if (policy == NULL || topo->count == 0) return 0;
+    if (n_threads > AFFINITY_MAX_CPUS) n_threads = AFFINITY_MAX_CPUS;
+
+    int list[AFFINITY_MAX_CPUS];
+    int listed = 0;
+    if (strcmp(policy, "compact") == 0 || strcmp(policy, "scatter") == 0) {
+        static CpuInfo sorted[AFFINITY_MAX_CPUS];
+        memcpy(sorted, topo->cpus, topo->count * sizeof(CpuInfo));
+        qsort(sorted, topo->count, sizeof(CpuInfo), strcmp(policy, "compact") == 0 ? compareCompact : compareScatter);
+        for (int c = 0; c < topo->count; c++) list[listed++] = sorted[c].cpu;
+    } else {
+        listed = parseCpuList(policy, list, AFFINITY_MAX_CPUS);
+    }
+    if (listed == 0) {
+        fprintf(stderr, "Unknown MATRIX_AFFINITY '%s' (compact, scatter or a CPU list such as 0,2,4-7), threads are not pinned\n", policy);
+        return 0;
+    }
+
+    for (int t = 0; t < n_threads; t++) affinityCpus[t] = list[t % listed];
+    affinityCount = n_threads;
+    return 1;
+}
+
+// CPU for worker index of a thread pool: the active policy if any, otherwise the index-th allowed CPU (-1 if unknown)
+static inline int affinityCPUFor(int index) {
+    if (affinityCount > 0) return affinityCpus[index % affinityCount];
+
+    unsigned long allowed[AFFINITY_MASK_WORDS];
+    int count = affinityAllowed(allowed);
+    if (count == 0) return -1;
+    index %= count;
+    for (int cpu = 0; cpu < AFFINITY_MAX_CPUS; cpu++) {
+        if (affinityIsSet(allowed, cpu) && index-- == 0) return cpu;
+    }
+    return -1;
+}
+
+#ifdef _OPENMP
+// Pins the calling thread to the CPU of its team member number under MATRIX_AFFINITY. The runtime does not have to
+// give team member t the same thread in every parallel region (nor keep its threads at all), so every parallel
+// region of the OpenMP kernels starts with this call; a thread only makes the system call when its CPU changes
+static inline void affinityPinTeamMember(void) {
+    static __thread int pinned = -1;
+    if (affinityCount == 0) return;
+
+    int cpu = affinityCpus[omp_get_thread_num() % affinityCount];
+    if (cpu != pinned && affinityPinSelf(cpu)) pinned = cpu;
+}
+
+// Plans the placement of n_threads threads from MATRIX_AFFINITY (applied by affinityPinTeamMember in every region),
+// pins a first team and prints the topology and where every thread ended up
+static inline void affinityApply(int n_threads) {
+    static Topology topo;
+    topologyDetect(&topo);
+    if (!affinityPlan(&topo, n_threads)) return;
+
+    int placed[AFFINITY_MAX_CPUS];
+    int threads = affinityCount;
+    for (int t = 0; t < threads; t++) placed[t] = -1;
+#pragma omp parallel num_threads(threads)
+    {
+        int t = omp_get_thread_num();
+        affinityPinTeamMember();
+        placed[t] = affinityCurrentCPU();
+    }
+
+    printf("Topology: %d packages, %d cores, %d CPUs, %d NUMA nodes\n", topo.packages, topo.cores, topo.count, topo.nodes);
+    printf("Affinity %s:", getenv("MATRIX_AFFINITY"));
+    for (int t = 0; t < threads; t++) {
+        const CpuInfo *c = topologyFind(&topo, placed[t]);
+        if (placed[t] < 0) {
+            printf(" %d->unused", t);
+        } else if (c != NULL) {
+            printf(" %d->%d(p%d/c%d/n%d)", t, c->cpu, c->package, c->core, c->node);
+        } else {
+            printf(" %d->%d", t, placed[t]);
+        }
+    }
+    printf("\n");
+}
+#else
+static inline void affinityPinTeamMember(void) {
+}
+#endif
+
+#endif
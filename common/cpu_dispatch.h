@@ -0,0 +1,147 @@
+#ifndef CPU_DISPATCH_H
+#define CPU_DISPATCH_H
+
+#include <cpuid.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "transpose_kernels.h"
+
+// Runtime selection of the tile kernels: the instruction set is detected once with cpuid (plus xgetbv to make
+// sure that the OS saves the wide registers) and the matching kernels are used for the rest of the run.
+// The MATRIX_ISA environment variable (scalar, sse, avx2, avx512) can force a lower tier for comparisons.
+
+typedef enum { ISA_SCALAR, ISA_SSE, ISA_AVX2, ISA_AVX512 } KernelISA;
+
+typedef struct {
+    KernelISA isa;
+    const char *name;
+    void (*transposeBlock)(const float *src, int lds, float *dst, int ldd, int rows, int cols);
+    int (*checkSymBlock)(const float *a, int lda, const float *b, int ldb, int rows, int cols, FloatCompare cmp);
+    void (*swapTransposeBlock)(float *a, int lda, float *b, int ldb, int rows, int cols);
+    void (*transposeSquareInPlace)(float *a, int ld, int n);
+    void (*transposeBlockStream)(const float *src, int lds, float *dst, int ldd, int rows, int cols);
+} KernelTable;
+
+static const KernelTable kernelTables[] = {
+    {ISA_SCALAR, "scalar", transposeBlockScalar, checkSymBlockScalar, swapTransposeBlockScalar, transposeSquareInPlaceScalar, transposeBlockScalar},
+    {ISA_SSE, "sse", transposeBlockSSE, checkSymBlockSSE, swapTransposeBlockSSE, transposeSquareInPlaceSSE, transposeBlockStreamSSE},
+    {ISA_AVX2, "avx2", transposeBlockAVX2, checkSymBlockAVX2, swapTransposeBlockAVX2, transposeSquareInPlaceAVX2, transposeBlockStreamAVX2},
+    {ISA_AVX512, "avx512", transposeBlockAVX512, checkSymBlockAVX512, swapTransposeBlockAVX512, transposeSquareInPlaceAVX512, transposeBlockStreamAVX512},
+};
+
+static inline KernelISA detectISA(void) {
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(edx & bit_SSE2)) return ISA_SCALAR;
+    if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX)) return ISA_SSE;
+
+    // XCR0: bits 1-2 are the XMM/YMM state, bits 5-7 the opmask and ZMM state
+    unsigned int xcr0_lo, xcr0_hi;
+    __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 0x06) != 0x06) return ISA_SSE;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) || !(ebx & bit_AVX2)) return ISA_SSE;
+    if (!(ebx & bit_AVX512F) || (xcr0_lo & 0xe6) != 0xe6) return ISA_AVX2;
+    return ISA_AVX512;
+}
+
+static inline const KernelTable *kernels(void) {
+    static const KernelTable *selected = NULL;
+
+    // Every thread that races here picks the same table, the atomic accesses only keep it a benign race
+    if (__atomic_load_n(&selected, __ATOMIC_ACQUIRE) == NULL) {
+        KernelISA isa = detectISA();
+        const char *requested = getenv("MATRIX_ISA");
+        if (requested != NULL) {
+            for (int k = 0; k <= (int)isa; k++) {
+                if (strcmp(requested, kernelTables[k].name) == 0) isa = (KernelISA)k;
+            }
+        }
+        __atomic_store_n(&selected, &kernelTables[isa], __ATOMIC_RELEASE);
+    }
+    return __atomic_load_n(&selected, __ATOMIC_ACQUIRE);
+}
+
+// Size in bytes of the last level cache: sysconf when the C library knows it, otherwise the largest cache
+// reported by cpuid leaf 4 (ways * partitions * line size * sets); 0 if unknown
+static inline size_t detectLLCSize(void) {
+    static size_t cached = (size_t)-1;
+
+    // Computed in a local and published with one atomic store, like kernels()
+    size_t llc = __atomic_load_n(&cached, __ATOMIC_ACQUIRE);
+    if (llc == (size_t)-1) {
+        long size = 0;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+        size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+        if (size <= 0) size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+        llc = size > 0 ? (size_t)size : 0;
+
+        unsigned int eax, ebx, ecx, edx;
+        for (unsigned int sub = 0; size <= 0 && __get_cpuid_count(4, sub, &eax, &ebx, &ecx, &edx) && (eax & 0x1f) != 0; sub++) {
+            size_t ways = ((ebx >> 22) & 0x3ff) + 1, partitions = ((ebx >> 12) & 0x3ff) + 1, line = (ebx & 0xfff) + 1, sets = (size_t)ecx + 1;
+            if (ways * partitions * line * sets > llc) llc = ways * partitions * line * sets;
+        }
+        __atomic_store_n(&cached, llc, __ATOMIC_RELEASE);
+    }
+    return llc;
+}
+
+// Non-temporal stores pay off once input and output no longer fit in the last level cache together: the output
+// would be evicted before being read again anyway. MATRIX_STREAMING=0/1 forces the choice for comparisons
+static inline int useStreamingStores(size_t inputBytes, size_t outputBytes) {
+    const char *forced = getenv("MATRIX_STREAMING");
+    if (forced != NULL) return atoi(forced) != 0;
+
+    size_t llc = detectLLCSize();
+    return llc > 0 && inputBytes + outputBytes > llc;
+}
+
+// Comparison used by the symmetry checks: MATRIX_COMPARE=bitwise, abs[:tolerance], rel[:tolerance] or ulp[:max_ulps]
+// (e.g. rel:1e-5, ulp:4). The default is the original absolute tolerance of 1e-6, also used (with a warning) when the
+// mode or the tolerance is not recognized. It is parsed once, by the first caller, the same way typedKernels fills its
+// tables (state 0 -> 1 -> 2), so that the threads calling it meanwhile never read a half written {mode, tolerance}
+static inline FloatCompare symmetryCompare(void) {
+    static FloatCompare cmp = {CMP_ABSOLUTE, 1e-6f};
+    static int state = 0;
+
+    int expected = 0;
+    if (__atomic_load_n(&state, __ATOMIC_ACQUIRE) != 2 &&
+        __atomic_compare_exchange_n(&state, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        const char *requested = getenv("MATRIX_COMPARE");
+        const char *value = requested != NULL ? strchr(requested, ':') : NULL;
+        size_t length = requested == NULL ? 0 : value != NULL ? (size_t)(value - requested) : strlen(requested);
+        FloatCompare parsed = {CMP_ABSOLUTE, 1e-6f};
+        if (requested != NULL) {
+            if (length == 7 && strncmp(requested, "bitwise", 7) == 0) {
+                parsed = (FloatCompare){CMP_BITWISE, 0.0f};
+            } else if (length == 3 && strncmp(requested, "rel", 3) == 0) {
+                parsed = (FloatCompare){CMP_RELATIVE, 1e-6f};
+            } else if (length == 3 && strncmp(requested, "ulp", 3) == 0) {
+                parsed = (FloatCompare){CMP_ULP, 4.0f};
+            } else if (length != 3 || strncmp(requested, "abs", 3) != 0) {
+                fprintf(stderr, "Unknown MATRIX_COMPARE '%s' (bitwise, abs[:tolerance], rel[:tolerance] or ulp[:max_ulps]), using abs:1e-6\n",
+                        requested);
+                value = NULL;
+            }
+        }
+        if (value != NULL) {
+            char *end;
+            double tolerance = strtod(value + 1, &end);
+            if (end != value + 1 && *end == '\0' && tolerance >= 0) {
+                parsed.tolerance = (float)tolerance;
+            } else {
+                fprintf(stderr, "Invalid MATRIX_COMPARE tolerance '%s', using %g\n", value + 1, parsed.tolerance);
+            }
+        }
+        cmp = parsed;
+        __atomic_store_n(&state, 2, __ATOMIC_RELEASE);
+    }
+    while (__atomic_load_n(&state, __ATOMIC_ACQUIRE) != 2) {
+    }
+    return cmp;
+}
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include "transpose_types.h"
+
+// Helpers for the MPI drivers that keep the matrix distributed across the ranks: every rank generates and checks
+// its own part, so nothing goes through rank 0. Element (i, j) has a value that only depends on (i, j) and on the
+// type, so a rank can check the rows of the transpose it ends up with without any communication.
+
+// First index of block k when n is split in parts blocks (sizes differ by at most one)
+static inline int blockStart(int n, int parts, int k) {
+    return (int)((long)n * k / parts);
+}
+
+// Number of the n indices split in blocks of size block dealt round robin to procs processes that land on proc
+// (the local dimension of a block-cyclic layout, NUMROC in ScaLAPACK)
+static inline int blockCyclicCount(int n, int block, int proc, int procs) {
+    int blocks = n / block;
+    int count = blocks / procs * block;
+    int extra = blocks % procs;
+    if (proc < extra) {
+        count += block;
+    } else if (proc == extra) {
+        count += n % block;
+    }
+    return count;
+}
+
+// Global index of the local index l of process proc in a block-cyclic layout
+static inline int blockCyclicGlobal(int l, int block, int proc, int procs) {
+    return (l / block * procs + proc) * block + l % block;
+}
+
+static inline uint32_t elementHash(uint32_t i, uint32_t j) {
+    uint32_t h = i * 0x9E3779B1u ^ j * 0x85EBCA77u;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    h *= 0x297A2D39u;
+    h ^= h >> 15;
+    return h;
+}
+
+// Value of element (i, j): in [0, 10) for floating point types (on each component), any value for integers
+static inline void typedElementAt(DType dtype, int i, int j, void *p) {
+    uint32_t h = elementHash((uint32_t)i, (uint32_t)j), g = elementHash(h, 0x5bd1e995u);
+    float f = (float)(h >> 8) * (10.0f / 16777216.0f), f2 = (float)(g >> 8) * (10.0f / 16777216.0f);
+
+    switch (dtype) {
+        case DTYPE_FLOAT: *(float *)p = f; break;
+        case DTYPE_DOUBLE: *(double *)p = (double)h / 4294967296.0 * 10.0; break;
+        case DTYPE_INT8: *(int8_t *)p = (int8_t)h; break;
+        case DTYPE_UINT8: *(uint8_t *)p = (uint8_t)h; break;
+        case DTYPE_INT16: *(int16_t *)p = (int16_t)h; break;
+        case DTYPE_INT32: *(int32_t *)p = (int32_t)h; break;
+        case DTYPE_COMPLEX64:
+            ((float *)p)[0] = f;
+            ((float *)p)[1] = f2;
+            break;
+        case DTYPE_COMPLEX128:
+            ((double *)p)[0] = (double)h / 4294967296.0 * 10.0;
+            ((double *)p)[1] = (double)g / 4294967296.0 * 10.0;
+            break;
+    }
+}
+
+// local holds rows firstRow .. of the global matrix
+static inline void typedFillRows(TypedMatrix *local, int firstRow) {
+    for (int i = 0; i < local->rows; i++) {
+        for (int j = 0; j < local->cols; j++) {
+            typedElementAt(local->dtype, firstRow + i, j, typedAt(local, i, j));
+        }
+    }
+}
+
+// Same for the symmetric matrix with element (i, j) of the other one on and above the diagonal
+static inline void typedFillRowsSymmetric(TypedMatrix *local, int firstRow) {
+    for (int i = 0; i < local->rows; i++) {
+        int gi = firstRow + i;
+        for (int j = 0; j < local->cols; j++) {
+            typedElementAt(local->dtype, gi < j ? gi : j, gi < j ? j : gi, typedAt(local, i, j));
+        }
+    }
+}
+
+// Returns 1 if local holds rows firstRow .. of the transpose of the matrix filled by typedFillRows (bit for bit)
+static inline int typedCheckTransposedRows(const TypedMatrix *local, int firstRow) {
+    size_t size = (size_t)dtypeInfo[local->dtype].size;
+    char expected[16];
+    for (int i = 0; i < local->rows; i++) {
+        for (int j = 0; j < local->cols; j++) {
+            typedElementAt(local->dtype, j, firstRow + i, expected);
+            if (memcmp(typedAt(local, i, j), expected, size) != 0) return 0;
+        }
+    }
+    return 1;
+}
+
+// local holds the elements of process (p, q) of a Pr x Pc grid when the matrix is split in rb x cb blocks
+static inline void typedFillBlockCyclic(TypedMatrix *local, int rb, int cb, int p, int q, int Pr, int Pc) {
+    for (int i = 0; i < local->rows; i++) {
+        int gi = blockCyclicGlobal(i, rb, p, Pr);
+        for (int j = 0; j < local->cols; j++) {
+            typedElementAt(local->dtype, gi, blockCyclicGlobal(j, cb, q, Pc), typedAt(local, i, j));
+        }
+    }
+}
+
+// Returns 1 if local holds the elements of process (p, q) of the transpose (in rb x cb blocks) of the matrix filled
+// by typedFillBlockCyclic or typedFillRows
+static inline int typedCheckBlockCyclicTransposed(const TypedMatrix *local, int rb, int cb, int p, int q, int Pr, int Pc) {
+    size_t size = (size_t)dtypeInfo[local->dtype].size;
+    char expected[16];
+    for (int i = 0; i < local->rows; i++) {
+        int gi = blockCyclicGlobal(i, rb, p, Pr);
+        for (int j = 0; j < local->cols; j++) {
+            typedElementAt(local->dtype, blockCyclicGlobal(j, cb, q, Pc), gi, expected);
+            if (memcmp(typedAt(local, i, j), expected, size) != 0) return 0;
+        }
+    }
+    return 1;
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef MATRIX_H
+#define MATRIX_H
+
+#include <stdlib.h>
+#include <string.h>
+
+// Every buffer starts on a cache line and every row starts on a cache line,
+// so that kernels can use aligned SIMD loads/stores (up to 512 bits)
+#define MATRIX_ALIGNMENT 64
+#define MATRIX_ALIGN_FLOATS (MATRIX_ALIGNMENT / (int)sizeof(float))
+
+// Row-major matrix stored in a single contiguous, aligned buffer.
+// Element (i, j) lives at data[i * ld + j], where ld (leading dimension) >= cols
+// is the row stride in elements, rounded up to a whole number of cache lines.
+typedef struct {
+    float *data;
+    int rows;
+    int cols;
+    int ld;
+} Matrix;
+
+#define MAT_AT(m, i, j) ((m)->data[(size_t)(i) * (size_t)(m)->ld + (size_t)(j)])
+
+// Pointer to the first element of row i
+static inline float *matrixRow(const Matrix *m, int i) { return m->data + (size_t)i * (size_t)m->ld; }
+
+static inline int matrixLeadingDim(int cols) { return (cols + MATRIX_ALIGN_FLOATS - 1) / MATRIX_ALIGN_FLOATS * MATRIX_ALIGN_FLOATS; }
+
+// Allocate a rows x cols matrix, returns 1 on success and 0 on failure (m->data is then NULL)
+static inline int matrixAlloc(Matrix *m, int rows, int cols) {
+    m->rows = rows;
+    m->cols = cols;
+    m->ld = matrixLeadingDim(cols);
+    m->data = NULL;
+
+    size_t bytes = (size_t)rows * (size_t)m->ld * sizeof(float);
+    if (bytes == 0) bytes = MATRIX_ALIGNMENT;
+    if (posix_memalign((void **)&m->data, MATRIX_ALIGNMENT, bytes) != 0) {
+        m->data = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+// Allocate a rows x cols matrix without row padding (ld == cols): only the start of the buffer is aligned.
+// Needed when the same buffer has to hold both the matrix and its transpose (in-place rectangular transposition)
+static inline int matrixAllocPacked(Matrix *m, int rows, int cols) {
+    if (!matrixAlloc(m, rows, cols)) return 0;
+    m->ld = cols;
+    return 1;
+}
+
+static inline void matrixFree(Matrix *m) {
+    free(m->data);
+    m->data = NULL;
+    m->rows = m->cols = m->ld = 0;
+}
+
+static inline void matrixZero(Matrix *m) { memset(m->data, 0, (size_t)m->rows * (size_t)m->ld * sizeof(float)); }
+
+#endif
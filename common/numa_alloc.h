@@ -0,0 +1,148 @@
+#ifndef NUMA_ALLOC_H
+#define NUMA_ALLOC_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifdef USE_LIBNUMA
+#include <numa.h>
+#endif
+
+#include "affinity.h"
+#include "matrix.h"
+
+// NUMA placement of the matrices used by the OpenMP drivers. Linux places a page on the node of the thread
+// that writes it first, so a serial initialization puts the whole matrix on one node:
+//  - serial:     original behaviour, the matrix is written by the main thread
+//  - firsttouch: every block is first written by the thread that processes it in the kernels
+//  - interleave: pages are spread round-robin over all the nodes (needs -DUSE_LIBNUMA and -lnuma)
+
+typedef enum { NUMA_SERIAL, NUMA_FIRST_TOUCH, NUMA_INTERLEAVE } NumaPolicy;
+
+static inline NumaPolicy numaPolicyFromString(const char *name) {
+    if (strcmp(name, "firsttouch") == 0) return NUMA_FIRST_TOUCH;
+    if (strcmp(name, "interleave") == 0) {
+#ifdef USE_LIBNUMA
+        if (numa_available() != -1) return NUMA_INTERLEAVE;
+#endif
+        fprintf(stderr, "Interleaving needs libnuma (-DUSE_LIBNUMA -lnuma) and a NUMA kernel, using first touch\n");
+        return NUMA_FIRST_TOUCH;
+    }
+    return NUMA_SERIAL;
+}
+
+static inline int matrixAllocNuma(Matrix *m, int rows, int cols, NumaPolicy policy) {
+#ifdef USE_LIBNUMA
+    if (policy == NUMA_INTERLEAVE) {
+        m->rows = rows;
+        m->cols = cols;
+        m->ld = matrixLeadingDim(cols);
+        m->data = (float *)numa_alloc_interleaved((size_t)rows * m->ld * sizeof(float));
+        return m->data != NULL;
+    }
+#endif
+    (void)policy;
+    return matrixAlloc(m, rows, cols);
+}
+
+static inline void matrixFreeNuma(Matrix *m, NumaPolicy policy) {
+#ifdef USE_LIBNUMA
+    if (policy == NUMA_INTERLEAVE) {
+        numa_free(m->data, (size_t)m->rows * m->ld * sizeof(float));
+        m->data = NULL;
+        m->rows = m->cols = m->ld = 0;
+        return;
+    }
+#endif
+    (void)policy;
+    matrixFree(m);
+}
+
+// Pseudo-random value in [0, 10) that only depends on (i, j), so that the matrix is the same whatever
+// thread initializes it (rand() is neither thread safe nor reproducible across threads)
+static inline float initialValue(int i, int j) {
+    uint32_t h = (uint32_t)i * 0x9E3779B1u ^ (uint32_t)j * 0x85EBCA77u;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return (float)(h >> 8) * (10.0f / 16777216.0f);
+}
+
+// Parallel first touch: the blockSize x blockSize blocks are handed to the threads with the same static schedule
+// as the kernels (collapse(2) over the blocks of the input, row-major), for the current OpenMP thread count.
+// With transposedOwner the matrix is an output: its block (j, i) is written by the thread that owns input block (i, j).
+// With values the matrix is filled with initialValue, otherwise with zeros
+static inline void matrixFirstTouch(Matrix *m, int blockSize, int transposedOwner, int values) {
+    int inRows = transposedOwner ? m->cols : m->rows;
+    int inCols = transposedOwner ? m->rows : m->cols;
+
+#pragma omp parallel
+    {
+        affinityPinTeamMember();
+#pragma omp for collapse(2) schedule(static)
+        for (int i = 0; i < inRows; i += blockSize) {
+            for (int j = 0; j < inCols; j += blockSize) {
+                int row0 = transposedOwner ? j : i;
+                int col0 = transposedOwner ? i : j;
+                int rowEnd = row0 + blockSize > m->rows ? m->rows : row0 + blockSize;
+                int colEnd = col0 + blockSize > m->cols ? m->cols : col0 + blockSize;
+
+                for (int ii = row0; ii < rowEnd; ii++) {
+                    for (int jj = col0; jj < colEnd; jj++) {
+                        MAT_AT(m, ii, jj) = values ? initialValue(ii, jj) : 0.0f;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Number of pages of the matrix on every NUMA node, asked to the kernel with move_pages (nothing is moved)
+static inline void numaReport(const char *name, const Matrix *m) {
+    enum { MAX_NODES = 64 };
+    size_t perNode[MAX_NODES] = {0};
+    size_t missing = 0;
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)m->data & ~(uintptr_t)(page - 1);
+    uintptr_t end = (uintptr_t)(m->data + (size_t)m->rows * m->ld);
+    size_t count = (end - start + page - 1) / page;
+
+    void **pages = (void **)malloc(count * sizeof(void *));
+    int *status = (int *)malloc(count * sizeof(int));
+    if (pages == NULL || status == NULL) {
+        printf("%s: not enough memory to query the page placement\n", name);
+        free(pages);
+        free(status);
+        return;
+    }
+    for (size_t k = 0; k < count; k++) {
+        pages[k] = (void *)(start + k * page);
+    }
+
+    if (syscall(SYS_move_pages, 0, (unsigned long)count, pages, NULL, status, 0) != 0) {
+        printf("%s: page placement not available on this system\n", name);
+    } else {
+        for (size_t k = 0; k < count; k++) {
+            if (status[k] >= 0 && status[k] < MAX_NODES) {
+                perNode[status[k]]++;
+            } else {
+                missing++;
+            }
+        }
+        printf("%s: %zu pages", name, count);
+        for (int node = 0; node < MAX_NODES; node++) {
+            if (perNode[node] > 0) printf(", node %d: %zu (%.1f%%)", node, perNode[node], 100.0 * perNode[node] / count);
+        }
+        if (missing > 0) printf(", not placed: %zu", missing);
+        printf("\n");
+    }
+
+    free(pages);
+    free(status);
+}
+
+#endif
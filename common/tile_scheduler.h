@@ -0,0 +1,150 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// Work-stealing scheduler over the tiles of a matrix, for the shapes where a static split of rows or blocks is
+// unbalanced (rectangular or non-power-of-two matrices, the triangle of tile pairs of the symmetry check).
+// The tiles are listed once in Morton (Z) order, so that consecutive tiles are close in both dimensions, and every
+// thread starts with a contiguous share of that list as its deque. A thread takes tiles from the front of its own
+// deque; once it is empty it steals the back half of another one, so stolen work is far from what the victim
+// touches next. A deque is a [head, tail) range packed in one 64-bit word, updated with compare-and-swap by both
+// the owner and the thieves.
+
+typedef struct {
+    uint64_t range; // head in the low 32 bits, tail in the high ones
+    char pad[64 - sizeof(uint64_t)];
+} TileDeque;
+
+typedef struct {
+    int rows, cols, tileSize;
+    int count;
+    uint64_t *order; // Morton keys (interleaved tile row and column) of the tiles, sorted
+    int n_threads;
+    TileDeque *deques;
+} TileScheduler;
+
+// Element coordinates and extent of a tile
+typedef struct {
+    int i, j;
+    int rows, cols;
+} Tile;
+
+static inline uint64_t mortonSpread(uint32_t x) {
+    uint64_t v = x;
+    v = (v | v << 16) & 0x0000ffff0000ffffULL;
+    v = (v | v << 8) & 0x00ff00ff00ff00ffULL;
+    v = (v | v << 4) & 0x0f0f0f0f0f0f0f0fULL;
+    v = (v | v << 2) & 0x3333333333333333ULL;
+    v = (v | v << 1) & 0x5555555555555555ULL;
+    return v;
+}
+
+static inline uint32_t mortonCompact(uint64_t v) {
+    v &= 0x5555555555555555ULL;
+    v = (v | v >> 1) & 0x3333333333333333ULL;
+    v = (v | v >> 2) & 0x0f0f0f0f0f0f0f0fULL;
+    v = (v | v >> 4) & 0x00ff00ff00ff00ffULL;
+    v = (v | v >> 8) & 0x0000ffff0000ffffULL;
+    v = (v | v >> 16) & 0x00000000ffffffffULL;
+    return (uint32_t)v;
+}
+
+static inline int mortonCompare(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static inline uint64_t tileRange(uint32_t head, uint32_t tail) {
+    return (uint64_t)tail << 32 | head;
+}
+
+// Deals the tiles to the deques again, to run the same schedule once more
+static inline void tileSchedulerReset(TileScheduler *s) {
+    for (int t = 0; t < s->n_threads; t++) {
+        uint32_t head = (uint32_t)((int64_t)s->count * t / s->n_threads);
+        uint32_t tail = (uint32_t)((int64_t)s->count * (t + 1) / s->n_threads);
+        __atomic_store_n(&s->deques[t].range, tileRange(head, tail), __ATOMIC_RELEASE);
+    }
+}
+
+// Tiles of tileSize x tileSize over a rows x cols matrix; with upperTriangle only the tiles (I, J) with I <= J
+// (square matrices, symmetry check). Returns 1 on success
+static inline int tileSchedulerInit(TileScheduler *s, int rows, int cols, int tileSize, int upperTriangle, int n_threads) {
+    int tileRows = (rows + tileSize - 1) / tileSize;
+    int tileCols = (cols + tileSize - 1) / tileSize;
+
+    s->rows = rows;
+    s->cols = cols;
+    s->tileSize = tileSize;
+    s->n_threads = n_threads < 1 ? 1 : n_threads;
+    s->count = 0;
+    s->order = (uint64_t *)malloc((size_t)tileRows * tileCols * sizeof(uint64_t));
+    s->deques = NULL;
+    if (s->order == NULL || posix_memalign((void **)&s->deques, 64, s->n_threads * sizeof(TileDeque)) != 0) {
+        free(s->order);
+        free(s->deques);
+        s->order = NULL;
+        s->deques = NULL;
+        return 0;
+    }
+
+    for (int I = 0; I < tileRows; I++) {
+        for (int J = upperTriangle ? I : 0; J < tileCols; J++) {
+            s->order[s->count++] = mortonSpread((uint32_t)I) << 1 | mortonSpread((uint32_t)J);
+        }
+    }
+    qsort(s->order, s->count, sizeof(uint64_t), mortonCompare);
+    tileSchedulerReset(s);
+    return 1;
+}
+
+static inline void tileSchedulerFree(TileScheduler *s) {
+    free(s->order);
+    free(s->deques);
+    s->order = NULL;
+    s->deques = NULL;
+}
+
+static inline void tileAt(const TileScheduler *s, uint32_t index, Tile *tile) {
+    uint64_t key = s->order[index];
+    tile->i = (int)mortonCompact(key >> 1) * s->tileSize;
+    tile->j = (int)mortonCompact(key) * s->tileSize;
+    tile->rows = tile->i + s->tileSize > s->rows ? s->rows - tile->i : s->tileSize;
+    tile->cols = tile->j + s->tileSize > s->cols ? s->cols - tile->j : s->tileSize;
+}
+
+// Next tile for thread self: the front of its own deque, otherwise the back half of the first non-empty deque
+// found (the rest of the stolen half becomes its deque). Returns 0 once every deque is empty
+static inline int tileNext(TileScheduler *s, int self, Tile *tile) {
+    TileDeque *own = &s->deques[self];
+    uint64_t range = __atomic_load_n(&own->range, __ATOMIC_ACQUIRE);
+    for (;;) {
+        uint32_t head = (uint32_t)range, tail = (uint32_t)(range >> 32);
+        if (head >= tail) break;
+        if (__atomic_compare_exchange_n(&own->range, &range, tileRange(head + 1, tail), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            tileAt(s, head, tile);
+            return 1;
+        }
+    }
+
+    for (int k = 1; k < s->n_threads; k++) {
+        TileDeque *victim = &s->deques[(self + k) % s->n_threads];
+        range = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+        for (;;) {
+            uint32_t head = (uint32_t)range, tail = (uint32_t)(range >> 32);
+            if (head >= tail) break;
+            uint32_t take = (tail - head + 1) / 2;
+            if (__atomic_compare_exchange_n(&victim->range, &range, tileRange(head, tail - take), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                // Only this thread can refill its own (empty) deque, thieves skip it until then
+                __atomic_store_n(&own->range, tileRange(tail - take + 1, tail), __ATOMIC_RELEASE);
+                tileAt(s, tail - take, tile);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+#endif
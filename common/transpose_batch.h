@@ -0,0 +1,101 @@
+#ifndef TRANSPOSE_BATCH_H
+#define TRANSPOSE_BATCH_H
+
+#include "affinity.h"
+#include "cpu_dispatch.h"
+
+// Batched transposition of many small matrices with the same shape. The whole batch is one parallel region
+// that hands out whole matrices to the threads, instead of one parallel region (and thread spin-up) per matrix.
+// Square sizes from 4 to 128 that are a multiple of the tile get a kernel with the size fixed at compile time:
+// the tile loops have constant bounds (fully unrolled for the smallest sizes) and there is no edge handling.
+
+typedef void (*FixedTransposeKernel)(const float *src, int lds, float *dst, int ldd);
+
+// Below this many elements in the whole batch, the batch is transposed by the calling thread alone
+#define BATCH_PARALLEL_MIN_ELEMENTS (64 * 1024)
+
+#define DEFINE_TRANSPOSE_FIXED(target, name, n, tile, tileKernel)                           \
+    static inline target void name(const float *src, int lds, float *dst, int ldd) {        \
+        for (int i = 0; i < (n); i += (tile)) {                                             \
+            for (int j = 0; j < (n); j += (tile)) {                                         \
+                tileKernel(src + (size_t)i * lds + j, lds, dst + (size_t)j * ldd + i, ldd); \
+            }                                                                               \
+        }                                                                                   \
+    }
+
+DEFINE_TRANSPOSE_FIXED(, transpose4SSE, 4, 4, transpose4x4SSE)
+DEFINE_TRANSPOSE_FIXED(, transpose8SSE, 8, 4, transpose4x4SSE)
+DEFINE_TRANSPOSE_FIXED(, transpose16SSE, 16, 4, transpose4x4SSE)
+DEFINE_TRANSPOSE_FIXED(, transpose32SSE, 32, 4, transpose4x4SSE)
+DEFINE_TRANSPOSE_FIXED(, transpose64SSE, 64, 4, transpose4x4SSE)
+DEFINE_TRANSPOSE_FIXED(, transpose128SSE, 128, 4, transpose4x4SSE)
+
+DEFINE_TRANSPOSE_FIXED(KERNEL_TARGET("avx2"), transpose8AVX2, 8, 8, transpose8x8AVX2)
+DEFINE_TRANSPOSE_FIXED(KERNEL_TARGET("avx2"), transpose16AVX2, 16, 8, transpose8x8AVX2)
+DEFINE_TRANSPOSE_FIXED(KERNEL_TARGET("avx2"), transpose32AVX2, 32, 8, transpose8x8AVX2)
+DEFINE_TRANSPOSE_FIXED(KERNEL_TARGET("avx2"), transpose64AVX2, 64, 8, transpose8x8AVX2)
+DEFINE_TRANSPOSE_FIXED(KERNEL_TARGET("avx2"), transpose128AVX2, 128, 8, transpose8x8AVX2)
+
+DEFINE_TRANSPOSE_FIXED(KERNEL_TARGET("avx512f"), transpose16AVX512, 16, 16, transpose16x16AVX512)
+DEFINE_TRANSPOSE_FIXED(KERNEL_TARGET("avx512f"), transpose32AVX512, 32, 16, transpose16x16AVX512)
+DEFINE_TRANSPOSE_FIXED(KERNEL_TARGET("avx512f"), transpose64AVX512, 64, 16, transpose16x16AVX512)
+DEFINE_TRANSPOSE_FIXED(KERNEL_TARGET("avx512f"), transpose128AVX512, 128, 16, transpose16x16AVX512)
+
+// Fixed-size kernel for n x n matrices on the selected instruction set (the widest tile that divides n),
+// NULL when there is none and the generic block kernel has to be used
+static inline FixedTransposeKernel fixedTransposeKernel(int n) {
+    // Indexed by [isa][log2(n) - 2] for n = 4 .. 128
+    static const FixedTransposeKernel fixed[][6] = {
+        {NULL, NULL, NULL, NULL, NULL, NULL},
+        {transpose4SSE, transpose8SSE, transpose16SSE, transpose32SSE, transpose64SSE, transpose128SSE},
+        {transpose4SSE, transpose8AVX2, transpose16AVX2, transpose32AVX2, transpose64AVX2, transpose128AVX2},
+        {transpose4SSE, transpose8AVX2, transpose16AVX512, transpose32AVX512, transpose64AVX512, transpose128AVX512},
+    };
+
+    for (int s = 0; s < 6; s++) {
+        if (n == 4 << s) return fixed[kernels()->isa][s];
+    }
+    return NULL;
+}
+
+// Transposes count rows x cols matrices: matrix b starts at src + b * srcStride and its transpose (cols x rows)
+// is written at dst + b * dstStride (strides and leading dimensions in elements)
+static inline void transposeBatchStrided(const float *src, size_t srcStride, int lds, float *dst, size_t dstStride, int ldd, int rows, int cols,
+                                         int count, int n_threads) {
+    const KernelTable *k = kernels();
+    FixedTransposeKernel fixed = rows == cols ? fixedTransposeKernel(rows) : NULL;
+
+#pragma omp parallel num_threads(n_threads) if ((size_t)count * rows * cols >= BATCH_PARALLEL_MIN_ELEMENTS)
+    {
+        affinityPinTeamMember();
+#pragma omp for schedule(static)
+        for (int b = 0; b < count; b++) {
+            if (fixed != NULL) {
+                fixed(src + (size_t)b * srcStride, lds, dst + (size_t)b * dstStride, ldd);
+            } else {
+                k->transposeBlock(src + (size_t)b * srcStride, lds, dst + (size_t)b * dstStride, ldd, rows, cols);
+            }
+        }
+    }
+}
+
+// Same for matrices anywhere in memory: the transpose of src[b] is written at dst[b]
+static inline void transposeBatchPtr(const float *const *src, int lds, float *const *dst, int ldd, int rows, int cols, int count, int n_threads) {
+    const KernelTable *k = kernels();
+    FixedTransposeKernel fixed = rows == cols ? fixedTransposeKernel(rows) : NULL;
+
+#pragma omp parallel num_threads(n_threads) if ((size_t)count * rows * cols >= BATCH_PARALLEL_MIN_ELEMENTS)
+    {
+        affinityPinTeamMember();
+#pragma omp for schedule(static)
+        for (int b = 0; b < count; b++) {
+            if (fixed != NULL) {
+                fixed(src[b], lds, dst[b], ldd);
+            } else {
+                k->transposeBlock(src[b], lds, dst[b], ldd, rows, cols);
+            }
+        }
+    }
+}
+
+#endif
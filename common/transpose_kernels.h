@@ -0,0 +1,594 @@
+#ifndef TRANSPOSE_KERNELS_H
+#define TRANSPOSE_KERNELS_H
+
+#include <immintrin.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// In-register tile kernels for transposition and symmetry check, one set per instruction set.
+// src/dst (a/b) are row-major with leading dimensions lds and ldd (in elements). Loads/stores are
+// unaligned so that the kernels can be used on any tile, on aligned Matrix rows they run at full speed.
+// Every function is compiled for its own target, so one binary contains all of them and the best one
+// is picked at runtime (see cpu_dispatch.h) instead of relying on -march=native.
+// Each block function covers the bulk with its own tile size and hands the edges to the next tier down.
+// The Stream variants write the output with non-temporal stores (no read-for-ownership, the output does not
+// evict the input from the caches): they need the output tiles to be aligned to the vector width, fall back to
+// regular stores otherwise, and the caller has to issue an _mm_sfence() once it is done writing.
+
+#define KERNEL_TARGET(isa) __attribute__((target(isa)))
+#define KERNEL_INLINE inline __attribute__((always_inline))
+
+// How the symmetry checks compare x = a[i][j] with y = b[j][i] (chosen at runtime, see symmetryCompare in cpu_dispatch.h):
+//  - bitwise:  same bits (+0 and -0 differ, a NaN matches the same NaN)
+//  - absolute: |x - y| <= tolerance
+//  - relative: |x - y| <= tolerance * max(|x|, |y|)
+//  - ulp:      at most tolerance representable floats between x and y
+// Every check kernel switches on the mode once per block and runs tile loops inlined for that mode only
+typedef enum { CMP_BITWISE, CMP_ABSOLUTE, CMP_RELATIVE, CMP_ULP } CompareMode;
+
+typedef struct {
+    CompareMode mode;
+    float tolerance;
+} FloatCompare;
+
+// Returns impl(args..., cmp) with a constant mode, so that the always_inline impl is specialized for each mode
+#define COMPARE_DISPATCH(impl, cmp, ...)                                                             \
+    switch ((cmp).mode) {                                                                            \
+        case CMP_BITWISE: return impl(__VA_ARGS__, (FloatCompare){CMP_BITWISE, (cmp).tolerance});   \
+        case CMP_RELATIVE: return impl(__VA_ARGS__, (FloatCompare){CMP_RELATIVE, (cmp).tolerance}); \
+        case CMP_ULP: return impl(__VA_ARGS__, (FloatCompare){CMP_ULP, (cmp).tolerance});           \
+        default: return impl(__VA_ARGS__, (FloatCompare){CMP_ABSOLUTE, (cmp).tolerance});           \
+    }
+
+/* ---------------------------------------------- Scalar ---------------------------------------------- */
+
+static inline void transposeBlockScalar(const float *src, int lds, float *dst, int ldd, int rows, int cols) {
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            dst[(size_t)j * ldd + i] = src[(size_t)i * lds + j];
+        }
+    }
+}
+
+// Floats mapped to integers in the same order (negative values become minus their magnitude bits, so that -0 and
+// +0 are both 0), the distance in ULPs between two floats is the difference of their integers
+static inline int32_t floatOrdered(float x) {
+    int32_t i;
+    memcpy(&i, &x, sizeof(i));
+    return (i ^ ((i >> 31) & 0x7fffffff)) - (i >> 31);
+}
+
+// Tolerance of the ulp mode as an integer, clamped first since casting a float out of range (or a NaN) is undefined
+static inline uint32_t ulpTolerance32(FloatCompare cmp) {
+    if (!(cmp.tolerance > 0)) return 0;
+    return cmp.tolerance >= 4294967296.0f ? UINT32_MAX : (uint32_t)cmp.tolerance;
+}
+
+static inline uint64_t ulpTolerance64(FloatCompare cmp) {
+    if (!(cmp.tolerance > 0)) return 0;
+    return cmp.tolerance >= 18446744073709551616.0f ? UINT64_MAX : (uint64_t)cmp.tolerance;
+}
+
+static KERNEL_INLINE int floatsDiffer(float x, float y, FloatCompare cmp) {
+    switch (cmp.mode) {
+        case CMP_BITWISE: return memcmp(&x, &y, sizeof(float)) != 0;
+        case CMP_RELATIVE: return fabsf(x - y) > cmp.tolerance * (fabsf(x) > fabsf(y) ? fabsf(x) : fabsf(y));
+        case CMP_ULP: {
+            int32_t ox = floatOrdered(x), oy = floatOrdered(y);
+            uint32_t distance = ox > oy ? (uint32_t)ox - (uint32_t)oy : (uint32_t)oy - (uint32_t)ox;
+            return distance > ulpTolerance32(cmp);
+        }
+        default: return fabsf(x - y) > cmp.tolerance;
+    }
+}
+
+static KERNEL_INLINE int checkSymBlockScalarMode(const float *a, int lda, const float *b, int ldb, int rows, int cols, FloatCompare cmp) {
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            if (floatsDiffer(a[(size_t)i * lda + j], b[(size_t)j * ldb + i], cmp)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Returns 1 if a[i][j] and b[j][i] match under cmp for every i < rows, j < cols
+static inline int checkSymBlockScalar(const float *a, int lda, const float *b, int ldb, int rows, int cols, FloatCompare cmp) {
+    COMPARE_DISPATCH(checkSymBlockScalarMode, cmp, a, lda, b, ldb, rows, cols)
+}
+
+// In place across two blocks: a (rows x cols) becomes the transpose of b (cols x rows) and vice versa,
+// used for mirror blocks on the two sides of the diagonal (a and b must not overlap)
+static inline void swapTransposeBlockScalar(float *a, int lda, float *b, int ldb, int rows, int cols) {
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            float tmp = a[(size_t)i * lda + j];
+            a[(size_t)i * lda + j] = b[(size_t)j * ldb + i];
+            b[(size_t)j * ldb + i] = tmp;
+        }
+    }
+}
+
+// In-place transposition of the n x n block starting at a
+static inline void transposeSquareInPlaceScalar(float *a, int ld, int n) {
+    for (int i = 0; i < n; i++) {
+        for (int j = i + 1; j < n; j++) {
+            float tmp = a[(size_t)i * ld + j];
+            a[(size_t)i * ld + j] = a[(size_t)j * ld + i];
+            a[(size_t)j * ld + i] = tmp;
+        }
+    }
+}
+
+/* ------------------------------------------- SSE (4x4 tiles) ------------------------------------------- */
+
+#define TRANSPOSE4x4_LOAD(r, p, ld)                \
+    __m128 r##0 = _mm_loadu_ps(p);                 \
+    __m128 r##1 = _mm_loadu_ps(p + (ld));          \
+    __m128 r##2 = _mm_loadu_ps(p + 2 * (size_t)(ld)); \
+    __m128 r##3 = _mm_loadu_ps(p + 3 * (size_t)(ld))
+
+static inline void transpose4x4SSE(const float *src, int lds, float *dst, int ldd) {
+    TRANSPOSE4x4_LOAD(r, src, lds);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+    _mm_storeu_ps(dst, r0);
+    _mm_storeu_ps(dst + ldd, r1);
+    _mm_storeu_ps(dst + 2 * (size_t)ldd, r2);
+    _mm_storeu_ps(dst + 3 * (size_t)ldd, r3);
+}
+
+static KERNEL_INLINE __m128i floatOrderedSSE(__m128 x) {
+    __m128i i = _mm_castps_si128(x), negative = _mm_srai_epi32(i, 31);
+    return _mm_sub_epi32(_mm_xor_si128(i, _mm_and_si128(negative, _mm_set1_epi32(0x7fffffff))), negative);
+}
+
+// Lanes where x and y differ under cmp, as a 4-bit mask
+static KERNEL_INLINE int cmpOutsideSSE(__m128 x, __m128 y, FloatCompare cmp) {
+    __m128 sign = _mm_set1_ps(-0.0f);
+    switch (cmp.mode) {
+        case CMP_BITWISE: return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_castps_si128(x), _mm_castps_si128(y)))) ^ 0xf;
+        case CMP_RELATIVE: {
+            __m128 diff = _mm_andnot_ps(sign, _mm_sub_ps(x, y));
+            __m128 scale = _mm_max_ps(_mm_andnot_ps(sign, x), _mm_andnot_ps(sign, y));
+            return _mm_movemask_ps(_mm_cmpgt_ps(diff, _mm_mul_ps(_mm_set1_ps(cmp.tolerance), scale)));
+        }
+        case CMP_ULP: {
+            // max - min of the ordered integers never overflows as an unsigned distance; the unsigned compare is a
+            // signed one with the sign bits flipped (SSE2 has neither min/max nor unsigned compares on 32-bit lanes)
+            __m128i ox = floatOrderedSSE(x), oy = floatOrderedSSE(y);
+            __m128i greater = _mm_cmpgt_epi32(ox, oy);
+            __m128i hi = _mm_or_si128(_mm_and_si128(greater, ox), _mm_andnot_si128(greater, oy));
+            __m128i lo = _mm_or_si128(_mm_and_si128(greater, oy), _mm_andnot_si128(greater, ox));
+            __m128i bias = _mm_set1_epi32(INT32_MIN);
+            __m128i limit = _mm_xor_si128(_mm_set1_epi32((int32_t)ulpTolerance32(cmp)), bias);
+            return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(_mm_xor_si128(_mm_sub_epi32(hi, lo), bias), limit)));
+        }
+        default: return _mm_movemask_ps(_mm_cmpgt_ps(_mm_andnot_ps(sign, _mm_sub_ps(x, y)), _mm_set1_ps(cmp.tolerance)));
+    }
+}
+
+static KERNEL_INLINE int checkSym4x4SSE(const float *a, int lda, const float *b, int ldb, FloatCompare cmp) {
+    TRANSPOSE4x4_LOAD(t, b, ldb);
+    _MM_TRANSPOSE4_PS(t0, t1, t2, t3);
+
+    int mask = cmpOutsideSSE(_mm_loadu_ps(a), t0, cmp);
+    mask |= cmpOutsideSSE(_mm_loadu_ps(a + lda), t1, cmp);
+    mask |= cmpOutsideSSE(_mm_loadu_ps(a + 2 * (size_t)lda), t2, cmp);
+    mask |= cmpOutsideSSE(_mm_loadu_ps(a + 3 * (size_t)lda), t3, cmp);
+    return mask == 0;
+}
+
+static inline void transposeBlockSSE(const float *src, int lds, float *dst, int ldd, int rows, int cols) {
+    int rows4 = rows & ~3;
+    int cols4 = cols & ~3;
+    for (int i = 0; i < rows4; i += 4) {
+        for (int j = 0; j < cols4; j += 4) {
+            transpose4x4SSE(src + (size_t)i * lds + j, lds, dst + (size_t)j * ldd + i, ldd);
+        }
+    }
+    // Right edge (full height), then bottom edge below the tiled part
+    transposeBlockScalar(src + cols4, lds, dst + (size_t)cols4 * ldd, ldd, rows, cols - cols4);
+    transposeBlockScalar(src + (size_t)rows4 * lds, lds, dst + rows4, ldd, rows - rows4, cols4);
+}
+
+static inline void transpose4x4StreamSSE(const float *src, int lds, float *dst, int ldd) {
+    TRANSPOSE4x4_LOAD(r, src, lds);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+    _mm_stream_ps(dst, r0);
+    _mm_stream_ps(dst + ldd, r1);
+    _mm_stream_ps(dst + 2 * (size_t)ldd, r2);
+    _mm_stream_ps(dst + 3 * (size_t)ldd, r3);
+}
+
+// Tiles that are next to each other in the output are written one after the other (i is the inner loop),
+// so that every cache line is completed in the write-combining buffers before moving on
+static inline void transposeBlockStreamSSE(const float *src, int lds, float *dst, int ldd, int rows, int cols) {
+    if (((uintptr_t)dst | (uintptr_t)ldd * sizeof(float)) & 15) {
+        transposeBlockSSE(src, lds, dst, ldd, rows, cols);
+        return;
+    }
+    int rows4 = rows & ~3;
+    int cols4 = cols & ~3;
+    for (int j = 0; j < cols4; j += 4) {
+        for (int i = 0; i < rows4; i += 4) {
+            transpose4x4StreamSSE(src + (size_t)i * lds + j, lds, dst + (size_t)j * ldd + i, ldd);
+        }
+    }
+    transposeBlockScalar(src + cols4, lds, dst + (size_t)cols4 * ldd, ldd, rows, cols - cols4);
+    transposeBlockScalar(src + (size_t)rows4 * lds, lds, dst + rows4, ldd, rows - rows4, cols4);
+}
+
+static KERNEL_INLINE int checkSymBlockSSEMode(const float *a, int lda, const float *b, int ldb, int rows, int cols, FloatCompare cmp) {
+    int rows4 = rows & ~3;
+    int cols4 = cols & ~3;
+    for (int i = 0; i < rows4; i += 4) {
+        for (int j = 0; j < cols4; j += 4) {
+            if (!checkSym4x4SSE(a + (size_t)i * lda + j, lda, b + (size_t)j * ldb + i, ldb, cmp)) return 0;
+        }
+    }
+    return checkSymBlockScalar(a + cols4, lda, b + (size_t)cols4 * ldb, ldb, rows, cols - cols4, cmp) &&
+           checkSymBlockScalar(a + (size_t)rows4 * lda, lda, b + rows4, ldb, rows - rows4, cols4, cmp);
+}
+
+static inline int checkSymBlockSSE(const float *a, int lda, const float *b, int ldb, int rows, int cols, FloatCompare cmp) {
+    COMPARE_DISPATCH(checkSymBlockSSEMode, cmp, a, lda, b, ldb, rows, cols)
+}
+
+static inline void swapTranspose4x4SSE(float *a, int lda, float *b, int ldb) {
+    TRANSPOSE4x4_LOAD(r, a, lda);
+    TRANSPOSE4x4_LOAD(t, b, ldb);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _MM_TRANSPOSE4_PS(t0, t1, t2, t3);
+
+    _mm_storeu_ps(a, t0);
+    _mm_storeu_ps(a + lda, t1);
+    _mm_storeu_ps(a + 2 * (size_t)lda, t2);
+    _mm_storeu_ps(a + 3 * (size_t)lda, t3);
+    _mm_storeu_ps(b, r0);
+    _mm_storeu_ps(b + ldb, r1);
+    _mm_storeu_ps(b + 2 * (size_t)ldb, r2);
+    _mm_storeu_ps(b + 3 * (size_t)ldb, r3);
+}
+
+static inline void swapTransposeBlockSSE(float *a, int lda, float *b, int ldb, int rows, int cols) {
+    int rows4 = rows & ~3;
+    int cols4 = cols & ~3;
+    for (int i = 0; i < rows4; i += 4) {
+        for (int j = 0; j < cols4; j += 4) {
+            swapTranspose4x4SSE(a + (size_t)i * lda + j, lda, b + (size_t)j * ldb + i, ldb);
+        }
+    }
+    swapTransposeBlockScalar(a + cols4, lda, b + (size_t)cols4 * ldb, ldb, rows, cols - cols4);
+    swapTransposeBlockScalar(a + (size_t)rows4 * lda, lda, b + rows4, ldb, rows - rows4, cols4);
+}
+
+// Diagonal tiles are transposed in place (every row is loaded before anything is stored),
+// tiles above the diagonal are swapped with their mirror; the untiled edge is handled by the next tier down
+static inline void transposeSquareInPlaceSSE(float *a, int ld, int n) {
+    int n4 = n & ~3;
+    for (int i = 0; i < n4; i += 4) {
+        transpose4x4SSE(a + (size_t)i * ld + i, ld, a + (size_t)i * ld + i, ld);
+        for (int j = i + 4; j < n4; j += 4) {
+            swapTranspose4x4SSE(a + (size_t)i * ld + j, ld, a + (size_t)j * ld + i, ld);
+        }
+    }
+    swapTransposeBlockScalar(a + n4, ld, a + (size_t)n4 * ld, ld, n4, n - n4);
+    transposeSquareInPlaceScalar(a + (size_t)n4 * ld + n4, ld, n - n4);
+}
+
+/* ------------------------------------------- AVX2 (8x8 tiles) ------------------------------------------- */
+
+// 8x8 transpose in three stages: unpack interleaves pairs of rows, shuffle builds 4-element columns
+// inside each 128-bit lane, permute2f128 swaps the lanes between the top and bottom half of the tile
+static inline KERNEL_TARGET("avx2") void transpose8x8RegsAVX2(__m256 r[8]) {
+    __m256 t[8], s[8];
+    for (int k = 0; k < 4; k++) {
+        t[2 * k] = _mm256_unpacklo_ps(r[2 * k], r[2 * k + 1]);
+        t[2 * k + 1] = _mm256_unpackhi_ps(r[2 * k], r[2 * k + 1]);
+    }
+    for (int k = 0; k < 2; k++) {
+        s[4 * k] = _mm256_shuffle_ps(t[4 * k], t[4 * k + 2], _MM_SHUFFLE(1, 0, 1, 0));
+        s[4 * k + 1] = _mm256_shuffle_ps(t[4 * k], t[4 * k + 2], _MM_SHUFFLE(3, 2, 3, 2));
+        s[4 * k + 2] = _mm256_shuffle_ps(t[4 * k + 1], t[4 * k + 3], _MM_SHUFFLE(1, 0, 1, 0));
+        s[4 * k + 3] = _mm256_shuffle_ps(t[4 * k + 1], t[4 * k + 3], _MM_SHUFFLE(3, 2, 3, 2));
+    }
+    for (int k = 0; k < 4; k++) {
+        r[k] = _mm256_permute2f128_ps(s[k], s[k + 4], 0x20);
+        r[k + 4] = _mm256_permute2f128_ps(s[k], s[k + 4], 0x31);
+    }
+}
+
+static inline KERNEL_TARGET("avx2") void transpose8x8AVX2(const float *src, int lds, float *dst, int ldd) {
+    __m256 r[8];
+    for (int k = 0; k < 8; k++) r[k] = _mm256_loadu_ps(src + (size_t)k * lds);
+    transpose8x8RegsAVX2(r);
+    for (int k = 0; k < 8; k++) _mm256_storeu_ps(dst + (size_t)k * ldd, r[k]);
+}
+
+// Lanes where x and y differ under cmp, as a vector of all-ones/all-zeros lanes (same scheme as cmpOutsideSSE)
+static KERNEL_INLINE KERNEL_TARGET("avx2") __m256 cmpOutsideAVX2(__m256 x, __m256 y, FloatCompare cmp) {
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    switch (cmp.mode) {
+        case CMP_BITWISE: {
+            __m256i equal = _mm256_cmpeq_epi32(_mm256_castps_si256(x), _mm256_castps_si256(y));
+            return _mm256_castsi256_ps(_mm256_xor_si256(equal, _mm256_set1_epi32(-1)));
+        }
+        case CMP_RELATIVE: {
+            __m256 diff = _mm256_andnot_ps(sign, _mm256_sub_ps(x, y));
+            __m256 scale = _mm256_max_ps(_mm256_andnot_ps(sign, x), _mm256_andnot_ps(sign, y));
+            return _mm256_cmp_ps(diff, _mm256_mul_ps(_mm256_set1_ps(cmp.tolerance), scale), _CMP_GT_OQ);
+        }
+        case CMP_ULP: {
+            __m256i mask = _mm256_set1_epi32(0x7fffffff);
+            __m256i ix = _mm256_castps_si256(x), iy = _mm256_castps_si256(y);
+            __m256i nx = _mm256_srai_epi32(ix, 31), ny = _mm256_srai_epi32(iy, 31);
+            __m256i ox = _mm256_sub_epi32(_mm256_xor_si256(ix, _mm256_and_si256(nx, mask)), nx);
+            __m256i oy = _mm256_sub_epi32(_mm256_xor_si256(iy, _mm256_and_si256(ny, mask)), ny);
+            __m256i distance = _mm256_sub_epi32(_mm256_max_epi32(ox, oy), _mm256_min_epi32(ox, oy));
+            __m256i bias = _mm256_set1_epi32(INT32_MIN);
+            __m256i limit = _mm256_xor_si256(_mm256_set1_epi32((int32_t)ulpTolerance32(cmp)), bias);
+            return _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_xor_si256(distance, bias), limit));
+        }
+        default: return _mm256_cmp_ps(_mm256_andnot_ps(sign, _mm256_sub_ps(x, y)), _mm256_set1_ps(cmp.tolerance), _CMP_GT_OQ);
+    }
+}
+
+static KERNEL_INLINE KERNEL_TARGET("avx2") int checkSym8x8AVX2(const float *a, int lda, const float *b, int ldb, FloatCompare cmp) {
+    __m256 r[8];
+    __m256 outside = _mm256_setzero_ps();
+    for (int k = 0; k < 8; k++) r[k] = _mm256_loadu_ps(b + (size_t)k * ldb);
+    transpose8x8RegsAVX2(r);
+    for (int k = 0; k < 8; k++) {
+        outside = _mm256_or_ps(outside, cmpOutsideAVX2(_mm256_loadu_ps(a + (size_t)k * lda), r[k], cmp));
+    }
+    return _mm256_movemask_ps(outside) == 0;
+}
+
+static inline KERNEL_TARGET("avx2") void transposeBlockAVX2(const float *src, int lds, float *dst, int ldd, int rows, int cols) {
+    int rows8 = rows & ~7;
+    int cols8 = cols & ~7;
+    for (int i = 0; i < rows8; i += 8) {
+        for (int j = 0; j < cols8; j += 8) {
+            transpose8x8AVX2(src + (size_t)i * lds + j, lds, dst + (size_t)j * ldd + i, ldd);
+        }
+    }
+    transposeBlockSSE(src + cols8, lds, dst + (size_t)cols8 * ldd, ldd, rows, cols - cols8);
+    transposeBlockSSE(src + (size_t)rows8 * lds, lds, dst + rows8, ldd, rows - rows8, cols8);
+}
+
+static inline KERNEL_TARGET("avx2") void transposeBlockStreamAVX2(const float *src, int lds, float *dst, int ldd, int rows, int cols) {
+    if (((uintptr_t)dst | (uintptr_t)ldd * sizeof(float)) & 31) {
+        transposeBlockAVX2(src, lds, dst, ldd, rows, cols);
+        return;
+    }
+    int rows8 = rows & ~7;
+    int cols8 = cols & ~7;
+    for (int j = 0; j < cols8; j += 8) {
+        for (int i = 0; i < rows8; i += 8) {
+            __m256 r[8];
+            const float *tile = src + (size_t)i * lds + j;
+            for (int k = 0; k < 8; k++) r[k] = _mm256_loadu_ps(tile + (size_t)k * lds);
+            transpose8x8RegsAVX2(r);
+            for (int k = 0; k < 8; k++) _mm256_stream_ps(dst + (size_t)(j + k) * ldd + i, r[k]);
+        }
+    }
+    transposeBlockStreamSSE(src + cols8, lds, dst + (size_t)cols8 * ldd, ldd, rows, cols - cols8);
+    transposeBlockStreamSSE(src + (size_t)rows8 * lds, lds, dst + rows8, ldd, rows - rows8, cols8);
+}
+
+static KERNEL_INLINE KERNEL_TARGET("avx2") int checkSymBlockAVX2Mode(const float *a, int lda, const float *b, int ldb, int rows, int cols,
+                                                                      FloatCompare cmp) {
+    int rows8 = rows & ~7;
+    int cols8 = cols & ~7;
+    for (int i = 0; i < rows8; i += 8) {
+        for (int j = 0; j < cols8; j += 8) {
+            if (!checkSym8x8AVX2(a + (size_t)i * lda + j, lda, b + (size_t)j * ldb + i, ldb, cmp)) return 0;
+        }
+    }
+    return checkSymBlockSSE(a + cols8, lda, b + (size_t)cols8 * ldb, ldb, rows, cols - cols8, cmp) &&
+           checkSymBlockSSE(a + (size_t)rows8 * lda, lda, b + rows8, ldb, rows - rows8, cols8, cmp);
+}
+
+static inline KERNEL_TARGET("avx2") int checkSymBlockAVX2(const float *a, int lda, const float *b, int ldb, int rows, int cols, FloatCompare cmp) {
+    COMPARE_DISPATCH(checkSymBlockAVX2Mode, cmp, a, lda, b, ldb, rows, cols)
+}
+
+static inline KERNEL_TARGET("avx2") void swapTranspose8x8AVX2(float *a, int lda, float *b, int ldb) {
+    __m256 r[8], t[8];
+    for (int k = 0; k < 8; k++) {
+        r[k] = _mm256_loadu_ps(a + (size_t)k * lda);
+        t[k] = _mm256_loadu_ps(b + (size_t)k * ldb);
+    }
+    transpose8x8RegsAVX2(r);
+    transpose8x8RegsAVX2(t);
+    for (int k = 0; k < 8; k++) {
+        _mm256_storeu_ps(a + (size_t)k * lda, t[k]);
+        _mm256_storeu_ps(b + (size_t)k * ldb, r[k]);
+    }
+}
+
+static inline KERNEL_TARGET("avx2") void swapTransposeBlockAVX2(float *a, int lda, float *b, int ldb, int rows, int cols) {
+    int rows8 = rows & ~7;
+    int cols8 = cols & ~7;
+    for (int i = 0; i < rows8; i += 8) {
+        for (int j = 0; j < cols8; j += 8) {
+            swapTranspose8x8AVX2(a + (size_t)i * lda + j, lda, b + (size_t)j * ldb + i, ldb);
+        }
+    }
+    swapTransposeBlockSSE(a + cols8, lda, b + (size_t)cols8 * ldb, ldb, rows, cols - cols8);
+    swapTransposeBlockSSE(a + (size_t)rows8 * lda, lda, b + rows8, ldb, rows - rows8, cols8);
+}
+
+static inline KERNEL_TARGET("avx2") void transposeSquareInPlaceAVX2(float *a, int ld, int n) {
+    int n8 = n & ~7;
+    for (int i = 0; i < n8; i += 8) {
+        transpose8x8AVX2(a + (size_t)i * ld + i, ld, a + (size_t)i * ld + i, ld);
+        for (int j = i + 8; j < n8; j += 8) {
+            swapTranspose8x8AVX2(a + (size_t)i * ld + j, ld, a + (size_t)j * ld + i, ld);
+        }
+    }
+    swapTransposeBlockSSE(a + n8, ld, a + (size_t)n8 * ld, ld, n8, n - n8);
+    transposeSquareInPlaceSSE(a + (size_t)n8 * ld + n8, ld, n - n8);
+}
+
+/* ------------------------------------------ AVX-512 (16x16 tiles) ------------------------------------------ */
+
+// Same scheme as the 8x8 kernel, with an extra stage: unpack and shuffle build 4x4 tiles inside each
+// 128-bit lane, then two rounds of shuffle_f32x4 move the lanes to their transposed position
+static inline KERNEL_TARGET("avx512f") void transpose16x16RegsAVX512(__m512 r[16]) {
+    __m512 t[16];
+    for (int k = 0; k < 8; k++) {
+        t[2 * k] = _mm512_unpacklo_ps(r[2 * k], r[2 * k + 1]);
+        t[2 * k + 1] = _mm512_unpackhi_ps(r[2 * k], r[2 * k + 1]);
+    }
+    for (int k = 0; k < 4; k++) {
+        r[4 * k] = _mm512_shuffle_ps(t[4 * k], t[4 * k + 2], _MM_SHUFFLE(1, 0, 1, 0));
+        r[4 * k + 1] = _mm512_shuffle_ps(t[4 * k], t[4 * k + 2], _MM_SHUFFLE(3, 2, 3, 2));
+        r[4 * k + 2] = _mm512_shuffle_ps(t[4 * k + 1], t[4 * k + 3], _MM_SHUFFLE(1, 0, 1, 0));
+        r[4 * k + 3] = _mm512_shuffle_ps(t[4 * k + 1], t[4 * k + 3], _MM_SHUFFLE(3, 2, 3, 2));
+    }
+    for (int k = 0; k < 4; k++) {
+        t[k] = _mm512_shuffle_f32x4(r[k], r[k + 4], 0x88);
+        t[k + 4] = _mm512_shuffle_f32x4(r[k], r[k + 4], 0xdd);
+        t[k + 8] = _mm512_shuffle_f32x4(r[k + 8], r[k + 12], 0x88);
+        t[k + 12] = _mm512_shuffle_f32x4(r[k + 8], r[k + 12], 0xdd);
+    }
+    for (int k = 0; k < 8; k++) {
+        r[k] = _mm512_shuffle_f32x4(t[k], t[k + 8], 0x88);
+        r[k + 8] = _mm512_shuffle_f32x4(t[k], t[k + 8], 0xdd);
+    }
+}
+
+static inline KERNEL_TARGET("avx512f") void transpose16x16AVX512(const float *src, int lds, float *dst, int ldd) {
+    __m512 r[16];
+    for (int k = 0; k < 16; k++) r[k] = _mm512_loadu_ps(src + (size_t)k * lds);
+    transpose16x16RegsAVX512(r);
+    for (int k = 0; k < 16; k++) _mm512_storeu_ps(dst + (size_t)k * ldd, r[k]);
+}
+
+// Lanes where x and y differ under cmp, as a mask (AVX-512 has the unsigned compare and min/max on 32-bit lanes)
+static KERNEL_INLINE KERNEL_TARGET("avx512f") __mmask16 cmpOutsideAVX512(__m512 x, __m512 y, FloatCompare cmp) {
+    switch (cmp.mode) {
+        case CMP_BITWISE: return _mm512_cmpneq_epi32_mask(_mm512_castps_si512(x), _mm512_castps_si512(y));
+        case CMP_RELATIVE: {
+            __m512 scale = _mm512_max_ps(_mm512_abs_ps(x), _mm512_abs_ps(y));
+            return _mm512_cmp_ps_mask(_mm512_abs_ps(_mm512_sub_ps(x, y)), _mm512_mul_ps(_mm512_set1_ps(cmp.tolerance), scale), _CMP_GT_OQ);
+        }
+        case CMP_ULP: {
+            __m512i mask = _mm512_set1_epi32(0x7fffffff);
+            __m512i ix = _mm512_castps_si512(x), iy = _mm512_castps_si512(y);
+            __m512i nx = _mm512_srai_epi32(ix, 31), ny = _mm512_srai_epi32(iy, 31);
+            __m512i ox = _mm512_sub_epi32(_mm512_xor_si512(ix, _mm512_and_si512(nx, mask)), nx);
+            __m512i oy = _mm512_sub_epi32(_mm512_xor_si512(iy, _mm512_and_si512(ny, mask)), ny);
+            __m512i distance = _mm512_sub_epi32(_mm512_max_epi32(ox, oy), _mm512_min_epi32(ox, oy));
+            return _mm512_cmpgt_epu32_mask(distance, _mm512_set1_epi32((int32_t)ulpTolerance32(cmp)));
+        }
+        default: return _mm512_cmp_ps_mask(_mm512_abs_ps(_mm512_sub_ps(x, y)), _mm512_set1_ps(cmp.tolerance), _CMP_GT_OQ);
+    }
+}
+
+static KERNEL_INLINE KERNEL_TARGET("avx512f") int checkSym16x16AVX512(const float *a, int lda, const float *b, int ldb, FloatCompare cmp) {
+    __m512 r[16];
+    __mmask16 outside = 0;
+    for (int k = 0; k < 16; k++) r[k] = _mm512_loadu_ps(b + (size_t)k * ldb);
+    transpose16x16RegsAVX512(r);
+    for (int k = 0; k < 16; k++) {
+        outside |= cmpOutsideAVX512(_mm512_loadu_ps(a + (size_t)k * lda), r[k], cmp);
+    }
+    return outside == 0;
+}
+
+static inline KERNEL_TARGET("avx512f") void transposeBlockAVX512(const float *src, int lds, float *dst, int ldd, int rows, int cols) {
+    int rows16 = rows & ~15;
+    int cols16 = cols & ~15;
+    for (int i = 0; i < rows16; i += 16) {
+        for (int j = 0; j < cols16; j += 16) {
+            transpose16x16AVX512(src + (size_t)i * lds + j, lds, dst + (size_t)j * ldd + i, ldd);
+        }
+    }
+    transposeBlockAVX2(src + cols16, lds, dst + (size_t)cols16 * ldd, ldd, rows, cols - cols16);
+    transposeBlockAVX2(src + (size_t)rows16 * lds, lds, dst + rows16, ldd, rows - rows16, cols16);
+}
+
+// Every 16-float row of a tile is a whole cache line, so the order of the tiles does not matter here
+static inline KERNEL_TARGET("avx512f") void transposeBlockStreamAVX512(const float *src, int lds, float *dst, int ldd, int rows, int cols) {
+    if (((uintptr_t)dst | (uintptr_t)ldd * sizeof(float)) & 63) {
+        transposeBlockAVX512(src, lds, dst, ldd, rows, cols);
+        return;
+    }
+    int rows16 = rows & ~15;
+    int cols16 = cols & ~15;
+    for (int i = 0; i < rows16; i += 16) {
+        for (int j = 0; j < cols16; j += 16) {
+            __m512 r[16];
+            const float *tile = src + (size_t)i * lds + j;
+            for (int k = 0; k < 16; k++) r[k] = _mm512_loadu_ps(tile + (size_t)k * lds);
+            transpose16x16RegsAVX512(r);
+            for (int k = 0; k < 16; k++) _mm512_stream_ps(dst + (size_t)(j + k) * ldd + i, r[k]);
+        }
+    }
+    transposeBlockStreamAVX2(src + cols16, lds, dst + (size_t)cols16 * ldd, ldd, rows, cols - cols16);
+    transposeBlockStreamAVX2(src + (size_t)rows16 * lds, lds, dst + rows16, ldd, rows - rows16, cols16);
+}
+
+static KERNEL_INLINE KERNEL_TARGET("avx512f") int checkSymBlockAVX512Mode(const float *a, int lda, const float *b, int ldb, int rows, int cols,
+                                                                           FloatCompare cmp) {
+    int rows16 = rows & ~15;
+    int cols16 = cols & ~15;
+    for (int i = 0; i < rows16; i += 16) {
+        for (int j = 0; j < cols16; j += 16) {
+            if (!checkSym16x16AVX512(a + (size_t)i * lda + j, lda, b + (size_t)j * ldb + i, ldb, cmp)) return 0;
+        }
+    }
+    return checkSymBlockAVX2(a + cols16, lda, b + (size_t)cols16 * ldb, ldb, rows, cols - cols16, cmp) &&
+           checkSymBlockAVX2(a + (size_t)rows16 * lda, lda, b + rows16, ldb, rows - rows16, cols16, cmp);
+}
+
+static inline KERNEL_TARGET("avx512f") int checkSymBlockAVX512(const float *a, int lda, const float *b, int ldb, int rows, int cols,
+                                                               FloatCompare cmp) {
+    COMPARE_DISPATCH(checkSymBlockAVX512Mode, cmp, a, lda, b, ldb, rows, cols)
+}
+
+static inline KERNEL_TARGET("avx512f") void swapTranspose16x16AVX512(float *a, int lda, float *b, int ldb) {
+    __m512 r[16], t[16];
+    for (int k = 0; k < 16; k++) {
+        r[k] = _mm512_loadu_ps(a + (size_t)k * lda);
+        t[k] = _mm512_loadu_ps(b + (size_t)k * ldb);
+    }
+    transpose16x16RegsAVX512(r);
+    transpose16x16RegsAVX512(t);
+    for (int k = 0; k < 16; k++) {
+        _mm512_storeu_ps(a + (size_t)k * lda, t[k]);
+        _mm512_storeu_ps(b + (size_t)k * ldb, r[k]);
+    }
+}
+
+static inline KERNEL_TARGET("avx512f") void swapTransposeBlockAVX512(float *a, int lda, float *b, int ldb, int rows, int cols) {
+    int rows16 = rows & ~15;
+    int cols16 = cols & ~15;
+    for (int i = 0; i < rows16; i += 16) {
+        for (int j = 0; j < cols16; j += 16) {
+            swapTranspose16x16AVX512(a + (size_t)i * lda + j, lda, b + (size_t)j * ldb + i, ldb);
+        }
+    }
+    swapTransposeBlockAVX2(a + cols16, lda, b + (size_t)cols16 * ldb, ldb, rows, cols - cols16);
+    swapTransposeBlockAVX2(a + (size_t)rows16 * lda, lda, b + rows16, ldb, rows - rows16, cols16);
+}
+
+static inline KERNEL_TARGET("avx512f") void transposeSquareInPlaceAVX512(float *a, int ld, int n) {
+    int n16 = n & ~15;
+    for (int i = 0; i < n16; i += 16) {
+        transpose16x16AVX512(a + (size_t)i * ld + i, ld, a + (size_t)i * ld + i, ld);
+        for (int j = i + 16; j < n16; j += 16) {
+            swapTranspose16x16AVX512(a + (size_t)i * ld + j, ld, a + (size_t)j * ld + i, ld);
+        }
+    }
+    swapTransposeBlockAVX2(a + n16, ld, a + (size_t)n16 * ld, ld, n16, n - n16);
+    transposeSquareInPlaceAVX2(a + (size_t)n16 * ld + n16, ld, n - n16);
+}
+
+#endif
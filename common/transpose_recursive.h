@@ -0,0 +1,47 @@
+#ifndef TRANSPOSE_RECURSIVE_H
+#define TRANSPOSE_RECURSIVE_H
+
+#include "cpu_dispatch.h"
+
+// Cache-oblivious transposition: the larger dimension is split in two until the block is small enough for
+// the in-register tile kernels (src and dst blocks together fit in L1), so every cache level is used
+// without knowing its size. Above the task cutoff one half becomes an OpenMP task.
+// Split points are rounded to multiples of 16 to keep the tiles aligned with the widest kernel.
+
+#define RECURSIVE_BASE_SIZE 32
+#define RECURSIVE_TASK_CUTOFF (128 * 128)
+
+static void transposeRecursive(const KernelTable *k, const float *src, int lds, float *dst, int ldd, int rows, int cols) {
+    if (rows <= RECURSIVE_BASE_SIZE && cols <= RECURSIVE_BASE_SIZE) {
+        k->transposeBlock(src, lds, dst, ldd, rows, cols);
+        return;
+    }
+
+    // Two halves: (src, dst) and (src2, dst2), split along the larger dimension
+    const float *src2;
+    float *dst2;
+    int rows1 = rows, cols1 = cols, rows2 = rows, cols2 = cols;
+    if (rows >= cols) {
+        rows1 = (rows / 2 + 15) & ~15;
+        rows2 = rows - rows1;
+        src2 = src + (size_t)rows1 * lds;
+        dst2 = dst + rows1;
+    } else {
+        cols1 = (cols / 2 + 15) & ~15;
+        cols2 = cols - cols1;
+        src2 = src + cols1;
+        dst2 = dst + (size_t)cols1 * ldd;
+    }
+
+    if ((size_t)rows * (size_t)cols > RECURSIVE_TASK_CUTOFF) {
+#pragma omp task
+        transposeRecursive(k, src, lds, dst, ldd, rows1, cols1);
+        transposeRecursive(k, src2, lds, dst2, ldd, rows2, cols2);
+#pragma omp taskwait
+    } else {
+        transposeRecursive(k, src, lds, dst, ldd, rows1, cols1);
+        transposeRecursive(k, src2, lds, dst2, ldd, rows2, cols2);
+    }
+}
+
+#endif
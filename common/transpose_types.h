@@ -0,0 +1,516 @@
+#ifndef TRANSPOSE_TYPES_H
+#define TRANSPOSE_TYPES_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu_dispatch.h"
+#include "matrix.h"
+
+// Element types other than float. Transposition only moves bits, so its tile kernels depend on the element
+// width alone (8, 16, 32, 64 or 128 bits): int32 shares the float tiles and complex64 the double ones.
+// The symmetry check also depends on how two elements are compared: within a tolerance for floating point
+// types (on each component for complex types), bit for bit for integers.
+// Include this header after mpi.h to also get the matching MPI datatypes (dtypeMPI).
+
+typedef enum { DTYPE_FLOAT, DTYPE_DOUBLE, DTYPE_INT8, DTYPE_UINT8, DTYPE_INT16, DTYPE_INT32, DTYPE_COMPLEX64, DTYPE_COMPLEX128 } DType;
+
+typedef enum { COMPARE_EXACT, COMPARE_FLOAT, COMPARE_DOUBLE } CompareKind;
+
+typedef struct {
+    const char *name;
+    int size;
+    CompareKind compare;
+} DTypeInfo;
+
+static const DTypeInfo dtypeInfo[] = {
+    {"float", 4, COMPARE_FLOAT}, {"double", 8, COMPARE_DOUBLE},  {"int8", 1, COMPARE_EXACT},      {"uint8", 1, COMPARE_EXACT},
+    {"int16", 2, COMPARE_EXACT}, {"int32", 4, COMPARE_EXACT},    {"complex64", 8, COMPARE_FLOAT}, {"complex128", 16, COMPARE_DOUBLE},
+};
+
+#define DTYPE_COUNT ((int)(sizeof(dtypeInfo) / sizeof(dtypeInfo[0])))
+
+// Returns the type with the given name, -1 if there is none
+static inline int dtypeFromString(const char *name) {
+    for (int d = 0; d < DTYPE_COUNT; d++) {
+        if (strcmp(name, dtypeInfo[d].name) == 0) return d;
+    }
+    return -1;
+}
+
+#ifdef MPI_VERSION
+static inline MPI_Datatype dtypeMPI(DType dtype) {
+    switch (dtype) {
+        case DTYPE_DOUBLE: return MPI_DOUBLE;
+        case DTYPE_INT8: return MPI_INT8_T;
+        case DTYPE_UINT8: return MPI_UINT8_T;
+        case DTYPE_INT16: return MPI_INT16_T;
+        case DTYPE_INT32: return MPI_INT32_T;
+        case DTYPE_COMPLEX64: return MPI_C_FLOAT_COMPLEX;
+        case DTYPE_COMPLEX128: return MPI_C_DOUBLE_COMPLEX;
+        default: return MPI_FLOAT;
+    }
+}
+#endif
+
+/* ------------------------------------------ Scalar, any width ------------------------------------------ */
+
+typedef struct {
+    uint64_t lo, hi;
+} Bits128;
+
+#define DEFINE_TRANSPOSE_BLOCK_SCALAR(bits, type)                                                                     \
+    static inline void transposeBlockScalar##bits(const void *src, int lds, void *dst, int ldd, int rows, int cols) { \
+        const type *s = (const type *)src;                                                                            \
+        type *d = (type *)dst;                                                                                        \
+        for (int i = 0; i < rows; i++) {                                                                              \
+            for (int j = 0; j < cols; j++) {                                                                          \
+                d[(size_t)j * ldd + i] = s[(size_t)i * lds + j];                                                      \
+            }                                                                                                         \
+        }                                                                                                             \
+    }
+
+DEFINE_TRANSPOSE_BLOCK_SCALAR(8, uint8_t)
+DEFINE_TRANSPOSE_BLOCK_SCALAR(16, uint16_t)
+DEFINE_TRANSPOSE_BLOCK_SCALAR(64, uint64_t)
+DEFINE_TRANSPOSE_BLOCK_SCALAR(128, Bits128)
+
+// 32-bit elements go through the float kernels of the detected instruction set
+static inline void transposeBlock32(const void *src, int lds, void *dst, int ldd, int rows, int cols) {
+    kernels()->transposeBlock((const float *)src, lds, (float *)dst, ldd, rows, cols);
+}
+
+// Returns 1 if the first bytes of x and y hold the same values under cmp. Integers are always compared bit for bit
+static inline int withinExact(const void *x, const void *y, size_t bytes, FloatCompare cmp) {
+    (void)cmp;
+    return memcmp(x, y, bytes) == 0;
+}
+
+static KERNEL_INLINE int withinFloatScalarMode(const float *a, const float *b, size_t n, FloatCompare cmp) {
+    for (size_t k = 0; k < n; k++) {
+        if (floatsDiffer(a[k], b[k], cmp)) return 0;
+    }
+    return 1;
+}
+
+static inline int withinFloatScalar(const void *x, const void *y, size_t bytes, FloatCompare cmp) {
+    COMPARE_DISPATCH(withinFloatScalarMode, cmp, (const float *)x, (const float *)y, bytes / sizeof(float))
+}
+
+// Same as floatsDiffer on doubles (the ULP distance uses the 64-bit ordered integers)
+static KERNEL_INLINE int doublesDiffer(double x, double y, FloatCompare cmp) {
+    switch (cmp.mode) {
+        case CMP_BITWISE: return memcmp(&x, &y, sizeof(double)) != 0;
+        case CMP_RELATIVE: return fabs(x - y) > cmp.tolerance * (fabs(x) > fabs(y) ? fabs(x) : fabs(y));
+        case CMP_ULP: {
+            int64_t ix, iy;
+            memcpy(&ix, &x, sizeof(ix));
+            memcpy(&iy, &y, sizeof(iy));
+            ix = (ix ^ ((ix >> 63) & INT64_MAX)) - (ix >> 63);
+            iy = (iy ^ ((iy >> 63) & INT64_MAX)) - (iy >> 63);
+            uint64_t distance = ix > iy ? (uint64_t)ix - (uint64_t)iy : (uint64_t)iy - (uint64_t)ix;
+            return distance > ulpTolerance64(cmp);
+        }
+        default: return fabs(x - y) > cmp.tolerance;
+    }
+}
+
+static KERNEL_INLINE int withinDoubleScalarMode(const double *a, const double *b, size_t n, FloatCompare cmp) {
+    for (size_t k = 0; k < n; k++) {
+        if (doublesDiffer(a[k], b[k], cmp)) return 0;
+    }
+    return 1;
+}
+
+static inline int withinDoubleScalar(const void *x, const void *y, size_t bytes, FloatCompare cmp) {
+    COMPARE_DISPATCH(withinDoubleScalarMode, cmp, (const double *)x, (const double *)y, bytes / sizeof(double))
+}
+
+/* ----------------------------- SSE2 (16x16 bytes, 8x8 words, 2x2 doubles) ----------------------------- */
+
+// Byte and word tiles are transposed by repeated perfect shuffles: interleaving row k with row k + N/2,
+// log2(N) times, moves every element to its transposed position (4 rounds for 16x16 bytes, 3 for 8x8 words)
+static inline void shuffleRoundEpi8(const __m128i *in, __m128i *out) {
+    for (int k = 0; k < 8; k++) {
+        out[2 * k] = _mm_unpacklo_epi8(in[k], in[k + 8]);
+        out[2 * k + 1] = _mm_unpackhi_epi8(in[k], in[k + 8]);
+    }
+}
+
+static inline void shuffleRoundEpi16(const __m128i *in, __m128i *out) {
+    for (int k = 0; k < 4; k++) {
+        out[2 * k] = _mm_unpacklo_epi16(in[k], in[k + 4]);
+        out[2 * k + 1] = _mm_unpackhi_epi16(in[k], in[k + 4]);
+    }
+}
+
+static inline void transpose16x16Epi8SSE(const uint8_t *src, int lds, uint8_t *dst, int ldd) {
+    __m128i r[16], t[16];
+    for (int k = 0; k < 16; k++) {
+        r[k] = _mm_loadu_si128((const __m128i *)(src + (size_t)k * lds));
+    }
+    shuffleRoundEpi8(r, t);
+    shuffleRoundEpi8(t, r);
+    shuffleRoundEpi8(r, t);
+    shuffleRoundEpi8(t, r);
+    for (int k = 0; k < 16; k++) {
+        _mm_storeu_si128((__m128i *)(dst + (size_t)k * ldd), r[k]);
+    }
+}
+
+static inline void transpose8x8Epi16SSE(const uint16_t *src, int lds, uint16_t *dst, int ldd) {
+    __m128i r[8], t[8];
+    for (int k = 0; k < 8; k++) {
+        r[k] = _mm_loadu_si128((const __m128i *)(src + (size_t)k * lds));
+    }
+    shuffleRoundEpi16(r, t);
+    shuffleRoundEpi16(t, r);
+    shuffleRoundEpi16(r, t);
+    for (int k = 0; k < 8; k++) {
+        _mm_storeu_si128((__m128i *)(dst + (size_t)k * ldd), t[k]);
+    }
+}
+
+static inline void transpose2x2PdSSE(const double *src, int lds, double *dst, int ldd) {
+    __m128d r0 = _mm_loadu_pd(src);
+    __m128d r1 = _mm_loadu_pd(src + lds);
+    _mm_storeu_pd(dst, _mm_unpacklo_pd(r0, r1));
+    _mm_storeu_pd(dst + ldd, _mm_unpackhi_pd(r0, r1));
+}
+
+// Block function compiled for target: tiles of tile x tile elements over the bulk, right and bottom edges to edgeKernel
+#define DEFINE_TRANSPOSE_BLOCK_TILED(target, name, type, tile, tileKernel, edgeKernel)                 \
+    static inline target void name(const void *src, int lds, void *dst, int ldd, int rows, int cols) { \
+        const type *s = (const type *)src;                                                             \
+        type *d = (type *)dst;                                                                         \
+        int rowsT = rows / (tile) * (tile);                                                            \
+        int colsT = cols / (tile) * (tile);                                                            \
+        for (int i = 0; i < rowsT; i += (tile)) {                                                      \
+            for (int j = 0; j < colsT; j += (tile)) {                                                  \
+                tileKernel(s + (size_t)i * lds + j, lds, d + (size_t)j * ldd + i, ldd);                \
+            }                                                                                          \
+        }                                                                                              \
+        edgeKernel(s + colsT, lds, d + (size_t)colsT * ldd, ldd, rows, cols - colsT);                  \
+        edgeKernel(s + (size_t)rowsT * lds, lds, d + rowsT, ldd, rows - rowsT, colsT);                 \
+    }
+
+DEFINE_TRANSPOSE_BLOCK_TILED(, transposeBlock8SSE, uint8_t, 16, transpose16x16Epi8SSE, transposeBlockScalar8)
+DEFINE_TRANSPOSE_BLOCK_TILED(, transposeBlock16SSE, uint16_t, 8, transpose8x8Epi16SSE, transposeBlockScalar16)
+DEFINE_TRANSPOSE_BLOCK_TILED(, transposeBlock64SSE, double, 2, transpose2x2PdSSE, transposeBlockScalar64)
+
+static KERNEL_INLINE int withinFloatSSEMode(const float *a, const float *b, size_t n, FloatCompare cmp) {
+    size_t n4 = n & ~(size_t)3;
+    for (size_t k = 0; k < n4; k += 4) {
+        if (cmpOutsideSSE(_mm_loadu_ps(a + k), _mm_loadu_ps(b + k), cmp)) return 0;
+    }
+    return withinFloatScalarMode(a + n4, b + n4, n - n4, cmp);
+}
+
+static inline int withinFloatSSE(const void *x, const void *y, size_t bytes, FloatCompare cmp) {
+    COMPARE_DISPATCH(withinFloatSSEMode, cmp, (const float *)x, (const float *)y, bytes / sizeof(float))
+}
+
+// Doubles mapped to the ordered 64-bit integers of doublesDiffer; SSE2 has no 64-bit arithmetic shift, so the sign
+// mask is the one of the high half copied to both halves
+static KERNEL_INLINE __m128i doubleOrderedSSE(__m128d x) {
+    __m128i i = _mm_castpd_si128(x), negative = _mm_shuffle_epi32(_mm_srai_epi32(i, 31), _MM_SHUFFLE(3, 3, 1, 1));
+    return _mm_sub_epi64(_mm_xor_si128(i, _mm_and_si128(negative, _mm_set1_epi64x(INT64_MAX))), negative);
+}
+
+// Unsigned 64-bit x > y on SSE2: the high halves decide unless they are equal, then the low halves do (both compared
+// as signed with the sign bits flipped); the result of the high half is copied to both halves
+static KERNEL_INLINE __m128i cmpgtEpu64SSE(__m128i x, __m128i y) {
+    __m128i bias = _mm_set1_epi32(INT32_MIN);
+    x = _mm_xor_si128(x, bias);
+    y = _mm_xor_si128(y, bias);
+    __m128i greater = _mm_cmpgt_epi32(x, y), equal = _mm_cmpeq_epi32(x, y);
+    __m128i high = _mm_or_si128(greater, _mm_and_si128(equal, _mm_shuffle_epi32(greater, _MM_SHUFFLE(2, 2, 0, 0))));
+    return _mm_shuffle_epi32(high, _MM_SHUFFLE(3, 3, 1, 1));
+}
+
+// Lanes where x and y are more than limit ULPs apart, as a 2-bit mask (max - min of the ordered integers never
+// overflows as an unsigned distance, like in cmpOutsideSSE)
+static KERNEL_INLINE int ulpOutsidePdSSE(__m128d x, __m128d y, __m128i limit) {
+    __m128i bias = _mm_set1_epi64x(INT64_MIN);
+    __m128i ox = doubleOrderedSSE(x), oy = doubleOrderedSSE(y);
+    __m128i greater = cmpgtEpu64SSE(_mm_xor_si128(ox, bias), _mm_xor_si128(oy, bias));
+    __m128i hi = _mm_or_si128(_mm_and_si128(greater, ox), _mm_andnot_si128(greater, oy));
+    __m128i lo = _mm_or_si128(_mm_and_si128(greater, oy), _mm_andnot_si128(greater, ox));
+    return _mm_movemask_pd(_mm_castsi128_pd(cmpgtEpu64SSE(_mm_sub_epi64(hi, lo), limit)));
+}
+
+// 2 doubles at a time (bitwise never gets here, see checkSymBlockTyped)
+static inline int withinDoubleSSE(const void *x, const void *y, size_t bytes, FloatCompare cmp) {
+    const double *a = (const double *)x, *b = (const double *)y;
+    size_t n = bytes / sizeof(double), n2 = n & ~(size_t)1;
+
+    if (cmp.mode == CMP_ULP) {
+        __m128i limit = _mm_set1_epi64x((int64_t)ulpTolerance64(cmp));
+        for (size_t k = 0; k < n2; k += 2) {
+            if (ulpOutsidePdSSE(_mm_loadu_pd(a + k), _mm_loadu_pd(b + k), limit)) return 0;
+        }
+        return withinDoubleScalar(a + n2, b + n2, (n - n2) * sizeof(double), cmp);
+    }
+
+    __m128d sign = _mm_set1_pd(-0.0), tolerance = _mm_set1_pd(cmp.tolerance);
+    for (size_t k = 0; k < n2; k += 2) {
+        __m128d va = _mm_loadu_pd(a + k), vb = _mm_loadu_pd(b + k);
+        __m128d limit = cmp.mode == CMP_RELATIVE ? _mm_mul_pd(tolerance, _mm_max_pd(_mm_andnot_pd(sign, va), _mm_andnot_pd(sign, vb))) : tolerance;
+        if (_mm_movemask_pd(_mm_cmpgt_pd(_mm_andnot_pd(sign, _mm_sub_pd(va, vb)), limit))) return 0;
+    }
+    return withinDoubleScalar(a + n2, b + n2, (n - n2) * sizeof(double), cmp);
+}
+
+/* ----------------------------------------- AVX2 (4x4 doubles) ----------------------------------------- */
+
+static inline KERNEL_TARGET("avx2") void transpose4x4PdAVX2(const double *src, int lds, double *dst, int ldd) {
+    __m256d r0 = _mm256_loadu_pd(src);
+    __m256d r1 = _mm256_loadu_pd(src + lds);
+    __m256d r2 = _mm256_loadu_pd(src + 2 * (size_t)lds);
+    __m256d r3 = _mm256_loadu_pd(src + 3 * (size_t)lds);
+
+    // Pairs within each 128-bit lane, then the lanes are exchanged
+    __m256d t0 = _mm256_unpacklo_pd(r0, r1);
+    __m256d t1 = _mm256_unpackhi_pd(r0, r1);
+    __m256d t2 = _mm256_unpacklo_pd(r2, r3);
+    __m256d t3 = _mm256_unpackhi_pd(r2, r3);
+
+    _mm256_storeu_pd(dst, _mm256_permute2f128_pd(t0, t2, 0x20));
+    _mm256_storeu_pd(dst + ldd, _mm256_permute2f128_pd(t1, t3, 0x20));
+    _mm256_storeu_pd(dst + 2 * (size_t)ldd, _mm256_permute2f128_pd(t0, t2, 0x31));
+    _mm256_storeu_pd(dst + 3 * (size_t)ldd, _mm256_permute2f128_pd(t1, t3, 0x31));
+}
+
+DEFINE_TRANSPOSE_BLOCK_TILED(KERNEL_TARGET("avx2"), transposeBlock64AVX2, double, 4, transpose4x4PdAVX2, transposeBlock64SSE)
+
+static KERNEL_INLINE KERNEL_TARGET("avx2") int withinFloatAVX2Mode(const float *a, const float *b, size_t n, FloatCompare cmp) {
+    size_t n8 = n & ~(size_t)7;
+    for (size_t k = 0; k < n8; k += 8) {
+        if (_mm256_movemask_ps(cmpOutsideAVX2(_mm256_loadu_ps(a + k), _mm256_loadu_ps(b + k), cmp))) return 0;
+    }
+    return withinFloatSSEMode(a + n8, b + n8, n - n8, cmp);
+}
+
+static inline KERNEL_TARGET("avx2") int withinFloatAVX2(const void *x, const void *y, size_t bytes, FloatCompare cmp) {
+    COMPARE_DISPATCH(withinFloatAVX2Mode, cmp, (const float *)x, (const float *)y, bytes / sizeof(float))
+}
+
+// Same as ulpOutsidePdSSE on 4 doubles; AVX2 has signed 64-bit compares but no 64-bit arithmetic shift or min/max
+static KERNEL_INLINE KERNEL_TARGET("avx2") int ulpOutsidePdAVX2(__m256d x, __m256d y, __m256i limit) {
+    __m256i mask = _mm256_set1_epi64x(INT64_MAX), bias = _mm256_set1_epi64x(INT64_MIN), zero = _mm256_setzero_si256();
+    __m256i ix = _mm256_castpd_si256(x), iy = _mm256_castpd_si256(y);
+    __m256i nx = _mm256_cmpgt_epi64(zero, ix), ny = _mm256_cmpgt_epi64(zero, iy);
+    __m256i ox = _mm256_sub_epi64(_mm256_xor_si256(ix, _mm256_and_si256(nx, mask)), nx);
+    __m256i oy = _mm256_sub_epi64(_mm256_xor_si256(iy, _mm256_and_si256(ny, mask)), ny);
+    __m256i greater = _mm256_cmpgt_epi64(ox, oy);
+    __m256i distance = _mm256_sub_epi64(_mm256_blendv_epi8(oy, ox, greater), _mm256_blendv_epi8(ox, oy, greater));
+    __m256i outside = _mm256_cmpgt_epi64(_mm256_xor_si256(distance, bias), _mm256_xor_si256(limit, bias));
+    return _mm256_movemask_pd(_mm256_castsi256_pd(outside));
+}
+
+static inline KERNEL_TARGET("avx2") int withinDoubleAVX2(const void *x, const void *y, size_t bytes, FloatCompare cmp) {
+    const double *a = (const double *)x, *b = (const double *)y;
+    size_t n = bytes / sizeof(double), n4 = n & ~(size_t)3;
+
+    if (cmp.mode == CMP_ULP) {
+        __m256i limit = _mm256_set1_epi64x((int64_t)ulpTolerance64(cmp));
+        for (size_t k = 0; k < n4; k += 4) {
+            if (ulpOutsidePdAVX2(_mm256_loadu_pd(a + k), _mm256_loadu_pd(b + k), limit)) return 0;
+        }
+        return withinDoubleSSE(a + n4, b + n4, (n - n4) * sizeof(double), cmp);
+    }
+
+    __m256d sign = _mm256_set1_pd(-0.0), tolerance = _mm256_set1_pd(cmp.tolerance);
+    for (size_t k = 0; k < n4; k += 4) {
+        __m256d va = _mm256_loadu_pd(a + k), vb = _mm256_loadu_pd(b + k);
+        __m256d limit =
+            cmp.mode == CMP_RELATIVE ? _mm256_mul_pd(tolerance, _mm256_max_pd(_mm256_andnot_pd(sign, va), _mm256_andnot_pd(sign, vb))) : tolerance;
+        if (_mm256_movemask_pd(_mm256_cmp_pd(_mm256_andnot_pd(sign, _mm256_sub_pd(va, vb)), limit, _CMP_GT_OQ))) return 0;
+    }
+    return withinDoubleSSE(a + n4, b + n4, (n - n4) * sizeof(double), cmp);
+}
+
+/* --------------------------------------- Per-type kernel tables --------------------------------------- */
+
+typedef struct {
+    DType dtype;
+    int size;
+    void (*transposeBlock)(const void *src, int lds, void *dst, int ldd, int rows, int cols);
+    int (*within)(const void *x, const void *y, size_t bytes, FloatCompare cmp);
+} TypedKernelTable;
+
+// Kernels for the given type on the instruction set picked by kernels(); the 8, 16 and 128-bit tiles
+// have no wider version, so AVX2/AVX-512 machines use the SSE2 ones (and AVX-512 the AVX2 double tiles).
+// The tables are filled once by the first caller (state 0 -> 1 -> 2); threads calling it meanwhile wait for the
+// release store of state 2, so that none of them sees a half filled table
+static inline const TypedKernelTable *typedKernels(DType dtype) {
+    static TypedKernelTable tables[DTYPE_COUNT];
+    static int state = 0;
+
+    int expected = 0;
+    if (__atomic_load_n(&state, __ATOMIC_ACQUIRE) != 2 &&
+        __atomic_compare_exchange_n(&state, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        KernelISA isa = kernels()->isa;
+        for (int d = 0; d < DTYPE_COUNT; d++) {
+            TypedKernelTable *t = &tables[d];
+            t->dtype = (DType)d;
+            t->size = dtypeInfo[d].size;
+            switch (t->size) {
+                case 1: t->transposeBlock = isa >= ISA_SSE ? transposeBlock8SSE : transposeBlockScalar8; break;
+                case 2: t->transposeBlock = isa >= ISA_SSE ? transposeBlock16SSE : transposeBlockScalar16; break;
+                case 4: t->transposeBlock = transposeBlock32; break;
+                case 8: t->transposeBlock = isa >= ISA_AVX2 ? transposeBlock64AVX2 : isa >= ISA_SSE ? transposeBlock64SSE : transposeBlockScalar64; break;
+                default: t->transposeBlock = transposeBlockScalar128; break;
+            }
+            switch (dtypeInfo[d].compare) {
+                case COMPARE_FLOAT: t->within = isa >= ISA_AVX2 ? withinFloatAVX2 : isa >= ISA_SSE ? withinFloatSSE : withinFloatScalar; break;
+                case COMPARE_DOUBLE: t->within = isa >= ISA_AVX2 ? withinDoubleAVX2 : isa >= ISA_SSE ? withinDoubleSSE : withinDoubleScalar; break;
+                default: t->within = withinExact; break;
+            }
+        }
+        __atomic_store_n(&state, 2, __ATOMIC_RELEASE);
+    }
+    while (__atomic_load_n(&state, __ATOMIC_ACQUIRE) != 2) {
+    }
+    return &tables[dtype];
+}
+
+#define TYPED_CHECK_TILE 32
+
+// Returns 1 if a[i][j] and b[j][i] match for every i < rows, j < cols. Floats use the in-register check of
+// cpu_dispatch.h; for the other types the mirror block is transposed tile by tile into a buffer with the
+// tile kernels of its width, and compared with a row by row
+static inline int checkSymBlockTyped(const TypedKernelTable *t, const void *a, int lda, const void *b, int ldb, int rows, int cols, FloatCompare cmp) {
+    if (t->dtype == DTYPE_FLOAT) {
+        return kernels()->checkSymBlock((const float *)a, lda, (const float *)b, ldb, rows, cols, cmp);
+    }
+    int (*within)(const void *, const void *, size_t, FloatCompare) = cmp.mode == CMP_BITWISE ? withinExact : t->within;
+
+    size_t size = (size_t)t->size;
+    _Alignas(MATRIX_ALIGNMENT) unsigned char tile[TYPED_CHECK_TILE * TYPED_CHECK_TILE * sizeof(Bits128)];
+    for (int i = 0; i < rows; i += TYPED_CHECK_TILE) {
+        for (int j = 0; j < cols; j += TYPED_CHECK_TILE) {
+            int h = rows - i < TYPED_CHECK_TILE ? rows - i : TYPED_CHECK_TILE;
+            int w = cols - j < TYPED_CHECK_TILE ? cols - j : TYPED_CHECK_TILE;
+
+            t->transposeBlock((const char *)b + ((size_t)j * ldb + i) * size, ldb, tile, TYPED_CHECK_TILE, w, h);
+            for (int ii = 0; ii < h; ii++) {
+                const char *row = (const char *)a + ((size_t)(i + ii) * lda + j) * size;
+                if (!within(row, tile + (size_t)ii * TYPED_CHECK_TILE * size, (size_t)w * size, cmp)) return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/* ------------------------------------------- Typed matrices ------------------------------------------- */
+
+// t->transposeBlock over blocks of TYPED_PARALLEL_BLOCK x TYPED_PARALLEL_BLOCK shared by n_threads OpenMP threads,
+// for the local transposes of the hybrid MPI drivers (serial when compiled without OpenMP)
+#define TYPED_PARALLEL_BLOCK 64
+
+static inline void transposeBlockTypedOMP(const TypedKernelTable *t, const void *src, int lds, void *dst, int ldd, int rows, int cols, int n_threads) {
+    size_t size = (size_t)t->size;
+    (void)n_threads;
+
+#pragma omp parallel for collapse(2) schedule(static) num_threads(n_threads) if (n_threads > 1)
+    for (int i = 0; i < rows; i += TYPED_PARALLEL_BLOCK) {
+        for (int j = 0; j < cols; j += TYPED_PARALLEL_BLOCK) {
+            int h = i + TYPED_PARALLEL_BLOCK > rows ? rows - i : TYPED_PARALLEL_BLOCK;
+            int w = j + TYPED_PARALLEL_BLOCK > cols ? cols - j : TYPED_PARALLEL_BLOCK;
+            t->transposeBlock((const char *)src + ((size_t)i * lds + j) * size, lds, (char *)dst + ((size_t)j * ldd + i) * size, ldd, h, w);
+        }
+    }
+}
+
+// Same layout as Matrix (rows padded to a whole cache line) for any element type
+typedef struct {
+    void *data;
+    int rows;
+    int cols;
+    int ld;
+    DType dtype;
+} TypedMatrix;
+
+static inline void *typedAt(const TypedMatrix *m, int i, int j) {
+    return (char *)m->data + ((size_t)i * (size_t)m->ld + (size_t)j) * (size_t)dtypeInfo[m->dtype].size;
+}
+
+// Allocate a rows x cols matrix of the given type, returns 1 on success and 0 on failure (m->data is then NULL)
+static inline int typedMatrixAlloc(TypedMatrix *m, int rows, int cols, DType dtype) {
+    int perLine = MATRIX_ALIGNMENT / dtypeInfo[dtype].size;
+    m->rows = rows;
+    m->cols = cols;
+    m->ld = (cols + perLine - 1) / perLine * perLine;
+    m->dtype = dtype;
+    m->data = NULL;
+
+    size_t bytes = (size_t)rows * (size_t)m->ld * (size_t)dtypeInfo[dtype].size;
+    if (bytes == 0) bytes = MATRIX_ALIGNMENT;
+    if (posix_memalign(&m->data, MATRIX_ALIGNMENT, bytes) != 0) {
+        m->data = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+// Without row padding (ld == cols), for buffers that are sent around as flat rows * cols arrays
+static inline int typedMatrixAllocPacked(TypedMatrix *m, int rows, int cols, DType dtype) {
+    if (!typedMatrixAlloc(m, rows, cols, dtype)) return 0;
+    m->ld = cols;
+    return 1;
+}
+
+static inline void typedMatrixFree(TypedMatrix *m) {
+    free(m->data);
+    m->data = NULL;
+    m->rows = m->cols = m->ld = 0;
+}
+
+static inline void typedMatrixZero(TypedMatrix *m) { memset(m->data, 0, (size_t)m->rows * (size_t)m->ld * (size_t)dtypeInfo[m->dtype].size); }
+
+// Random values in [0, 10) for floating point types (on each component), over the whole range for integers
+static inline void typedRandomElement(DType dtype, void *p) {
+    switch (dtype) {
+        case DTYPE_FLOAT: *(float *)p = (float)rand() / RAND_MAX * 10.0f; break;
+        case DTYPE_DOUBLE: *(double *)p = (double)rand() / RAND_MAX * 10.0; break;
+        case DTYPE_INT8: *(int8_t *)p = (int8_t)rand(); break;
+        case DTYPE_UINT8: *(uint8_t *)p = (uint8_t)rand(); break;
+        case DTYPE_INT16: *(int16_t *)p = (int16_t)rand(); break;
+        case DTYPE_INT32: *(int32_t *)p = (int32_t)rand(); break;
+        case DTYPE_COMPLEX64:
+            ((float *)p)[0] = (float)rand() / RAND_MAX * 10.0f;
+            ((float *)p)[1] = (float)rand() / RAND_MAX * 10.0f;
+            break;
+        case DTYPE_COMPLEX128:
+            ((double *)p)[0] = (double)rand() / RAND_MAX * 10.0;
+            ((double *)p)[1] = (double)rand() / RAND_MAX * 10.0;
+            break;
+    }
+}
+
+static inline void typedMatrixRandom(TypedMatrix *m) {
+    for (int i = 0; i < m->rows; i++) {
+        for (int j = 0; j < m->cols; j++) {
+            typedRandomElement(m->dtype, typedAt(m, i, j));
+        }
+    }
+}
+
+// Transposition only copies elements, so the result is checked bit for bit
+static inline int typedCheckTranspose(const TypedMatrix *matrix, const TypedMatrix *transposed) {
+    size_t size = (size_t)dtypeInfo[matrix->dtype].size;
+    for (int i = 0; i < matrix->rows; i++) {
+        for (int j = 0; j < matrix->cols; j++) {
+            if (memcmp(typedAt(matrix, i, j), typedAt(transposed, j, i), size) != 0) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+#endif
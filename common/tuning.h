@@ -0,0 +1,115 @@
+#ifndef TUNING_H
+#define TUNING_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Tuning database: best block size and prefetch distance found by the autotuner for every
+// (kernel, dtype, size, thread count) combination on this host. It is a plain text file, one
+// entry per line, written by the tuning runs and loaded by the normal runs.
+// The file is MATRIX_TUNING_FILE if set, tuning_<hostname>.txt in the working directory otherwise.
+
+typedef struct {
+    char kernel[32];
+    char dtype[16];
+    int n;
+    int threads;
+    int blockSize;
+    int prefetchDistance;
+    double timeMs;
+} TuningEntry;
+
+typedef struct {
+    TuningEntry *entries;
+    int count;
+    int capacity;
+} TuningDB;
+
+static inline void tuningPath(char *path, size_t size) {
+    const char *file = getenv("MATRIX_TUNING_FILE");
+    if (file != NULL) {
+        snprintf(path, size, "%s", file);
+        return;
+    }
+    char host[64] = "localhost";
+    gethostname(host, sizeof(host) - 1);
+    host[sizeof(host) - 1] = '\0';
+    snprintf(path, size, "tuning_%s.txt", host);
+}
+
+static inline int tuningSameKey(const TuningEntry *a, const char *kernel, const char *dtype, int n, int threads) {
+    return a->n == n && a->threads == threads && strcmp(a->kernel, kernel) == 0 && strcmp(a->dtype, dtype) == 0;
+}
+
+// Add an entry, replacing the one with the same key if there is one (the latest tuning run wins).
+// Returns 0 (and leaves db unchanged) if there is no memory for a new entry
+static inline int tuningRecord(TuningDB *db, const TuningEntry *entry) {
+    for (int i = 0; i < db->count; i++) {
+        if (tuningSameKey(&db->entries[i], entry->kernel, entry->dtype, entry->n, entry->threads)) {
+            db->entries[i] = *entry;
+            return 1;
+        }
+    }
+    if (db->count == db->capacity) {
+        int capacity = db->capacity == 0 ? 64 : db->capacity * 2;
+        TuningEntry *entries = (TuningEntry *)realloc(db->entries, capacity * sizeof(TuningEntry));
+        if (entries == NULL) return 0;
+        db->entries = entries;
+        db->capacity = capacity;
+    }
+    db->entries[db->count++] = *entry;
+    return 1;
+}
+
+// Best entry for the given key; threads == 0 returns the fastest entry over all the thread counts tuned
+static inline const TuningEntry *tuningFind(const TuningDB *db, const char *kernel, const char *dtype, int n, int threads) {
+    const TuningEntry *best = NULL;
+    for (int i = 0; i < db->count; i++) {
+        const TuningEntry *e = &db->entries[i];
+        if (!tuningSameKey(e, kernel, dtype, n, threads == 0 ? e->threads : threads)) continue;
+        if (best == NULL || e->timeMs < best->timeMs) best = e;
+    }
+    return best;
+}
+
+// Returns the number of entries loaded, 0 if the file does not exist (loading stops if memory runs out)
+static inline int tuningLoad(TuningDB *db, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) return 0;
+
+    char line[256];
+    int loaded = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        TuningEntry e;
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%31s %15s %d %d %d %d %lf", e.kernel, e.dtype, &e.n, &e.threads, &e.blockSize, &e.prefetchDistance, &e.timeMs) == 7) {
+            if (!tuningRecord(db, &e)) break;
+            loaded++;
+        }
+    }
+    fclose(file);
+    return loaded;
+}
+
+static inline int tuningSave(const TuningDB *db, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) return 0;
+
+    fprintf(file, "# kernel dtype n threads block_size prefetch_distance time_ms\n");
+    for (int i = 0; i < db->count; i++) {
+        const TuningEntry *e = &db->entries[i];
+        fprintf(file, "%s %s %d %d %d %d %.6f\n", e->kernel, e->dtype, e->n, e->threads, e->blockSize, e->prefetchDistance, e->timeMs);
+    }
+    fclose(file);
+    return 1;
+}
+
+static inline void tuningFree(TuningDB *db) {
+    free(db->entries);
+    db->entries = NULL;
+    db->count = db->capacity = 0;
+}
+
+#endif
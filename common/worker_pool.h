@@ -0,0 +1,169 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <limits.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <xmmintrin.h>
+
+#include "affinity.h"
+
+// Persistent worker pool: the threads are created (and pinned) once, then every job is handed to them by bumping a
+// generation counter, instead of opening a new OpenMP parallel region (and resizing the team) on every call.
+// Waiting threads spin on the counter for a while and then sleep on it with a futex, so back-to-back jobs are
+// picked up in about a microsecond while an idle pool does not burn the cores (with more workers than CPUs they sleep
+// right away, spinning would only delay the thread being waited for). The submitting thread is worker 0 and runs
+// its share of the job too; workers 1 .. n-1 are pinned to the CPUs of the MATRIX_AFFINITY policy (affinity.h),
+// the following CPUs of the process mask without one.
+
+typedef void (*PoolJob)(void *arg, int worker, int n_workers);
+
+typedef struct {
+    pthread_t *threads;
+    int n_workers;
+    PoolJob job;
+    void *arg;
+    int generation; // futex word: bumped once per job
+    int remaining;  // futex word: workers still running the current job
+    int sleepers;   // workers sleeping on generation
+    int waiting;    // the submitter is sleeping on remaining
+    int stop;
+    int spin; // spin iterations before sleeping
+} WorkerPool;
+
+typedef struct {
+    WorkerPool *pool;
+    int worker;
+} PoolWorkerArg;
+
+// Spin iterations (with pause) before sleeping: from tens to a few hundred microseconds depending on the pause latency
+#define POOL_SPIN_ITERATIONS (1 << 12)
+
+static inline void poolFutexWait(int *word, int value) {
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+static inline void poolFutexWake(int *word) {
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+// Waits until *word != value: spin first, then sleep with the sleepers count raised so that the writer knows to wake us
+static inline int poolWaitChange(int *word, int value, int *sleepers, int maxSpin) {
+    int current;
+    for (int spin = 0; (current = __atomic_load_n(word, __ATOMIC_ACQUIRE)) == value; spin++) {
+        if (spin < maxSpin) {
+            _mm_pause();
+            continue;
+        }
+        __atomic_add_fetch(sleepers, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(word, __ATOMIC_SEQ_CST) == value) poolFutexWait(word, value);
+        __atomic_sub_fetch(sleepers, 1, __ATOMIC_SEQ_CST);
+    }
+    return current;
+}
+
+static inline void poolFinishJob(WorkerPool *pool) {
+    if (__atomic_sub_fetch(&pool->remaining, 1, __ATOMIC_SEQ_CST) == 0 && __atomic_load_n(&pool->waiting, __ATOMIC_SEQ_CST)) {
+        poolFutexWake(&pool->remaining);
+    }
+}
+
+static inline void *poolWorkerMain(void *data) {
+    PoolWorkerArg *self = (PoolWorkerArg *)data;
+    WorkerPool *pool = self->pool;
+    int worker = self->worker;
+    free(self);
+
+    affinityPinSelf(affinityCPUFor(worker));
+    int seen = 0;
+    for (;;) {
+        seen = poolWaitChange(&pool->generation, seen, &pool->sleepers, pool->spin);
+        if (__atomic_load_n(&pool->stop, __ATOMIC_ACQUIRE)) break;
+        pool->job(pool->arg, worker, pool->n_workers);
+        poolFinishJob(pool);
+    }
+    return NULL;
+}
+
+// Creates n_workers - 1 threads (the caller is the remaining worker). Returns 1 if all of them started, otherwise 0
+// with pool->n_workers set to the workers that did; poolDestroy is needed in both cases
+static inline int poolCreate(WorkerPool *pool, int n_workers) {
+    int requested = n_workers < 1 ? 1 : n_workers;
+    pool->n_workers = n_workers < 1 ? 1 : n_workers;
+    pool->job = NULL;
+    pool->arg = NULL;
+    pool->generation = pool->remaining = pool->sleepers = pool->waiting = pool->stop = 0;
+
+    unsigned long allowed[AFFINITY_MASK_WORDS];
+    pool->spin = pool->n_workers <= affinityAllowed(allowed) ? POOL_SPIN_ITERATIONS : 0;
+    pool->threads = (pthread_t *)malloc(pool->n_workers * sizeof(pthread_t));
+    if (pool->threads == NULL) {
+        pool->n_workers = 1;
+        return 0;
+    }
+
+    for (int w = 1; w < pool->n_workers; w++) {
+        PoolWorkerArg *arg = (PoolWorkerArg *)malloc(sizeof(PoolWorkerArg));
+        if (arg == NULL) {
+            pool->n_workers = w;
+            break;
+        }
+        arg->pool = pool;
+        arg->worker = w;
+        if (pthread_create(&pool->threads[w], NULL, poolWorkerMain, arg) != 0) {
+            free(arg);
+            pool->n_workers = w;
+            break;
+        }
+    }
+    return pool->n_workers == requested;
+}
+
+// Runs job(arg, worker, n_workers) on every worker and returns when all of them are done
+static inline void poolRun(WorkerPool *pool, PoolJob job, void *arg) {
+    if (pool->n_workers == 1) {
+        job(arg, 0, 1);
+        return;
+    }
+
+    pool->job = job;
+    pool->arg = arg;
+    __atomic_store_n(&pool->remaining, pool->n_workers - 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&pool->generation, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->sleepers, __ATOMIC_SEQ_CST) > 0) poolFutexWake(&pool->generation);
+
+    job(arg, 0, pool->n_workers);
+
+    int remaining;
+    for (int spin = 0; (remaining = __atomic_load_n(&pool->remaining, __ATOMIC_ACQUIRE)) != 0; spin++) {
+        if (spin < pool->spin) {
+            _mm_pause();
+            continue;
+        }
+        __atomic_store_n(&pool->waiting, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&pool->remaining, __ATOMIC_SEQ_CST) != 0) poolFutexWait(&pool->remaining, remaining);
+        __atomic_store_n(&pool->waiting, 0, __ATOMIC_SEQ_CST);
+    }
+}
+
+static inline void poolDestroy(WorkerPool *pool) {
+    __atomic_store_n(&pool->stop, 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&pool->generation, 1, __ATOMIC_SEQ_CST);
+    poolFutexWake(&pool->generation);
+    for (int w = 1; w < pool->n_workers; w++) {
+        pthread_join(pool->threads[w], NULL);
+    }
+    free(pool->threads);
+    pool->threads = NULL;
+}
+
+// Next chunk of a shared [0, end) range in steps of chunk, -1 once the range is exhausted (dynamic scheduling)
+static inline int poolNextChunk(int *next, int chunk, int end) {
+    int start = __atomic_fetch_add(next, chunk, __ATOMIC_RELAXED);
+    return start < end ? start : -1;
+}
+
+#endif
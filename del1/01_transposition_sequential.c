@@ -3,30 +3,35 @@
 #include <stdlib.h>
 #include <sys/time.h>
 
-void initializeMatrixAsym(float **matrix, int n) {
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < n; j++) {
-            matrix[i][j] = (float)rand() / RAND_MAX * 100;
+#include "../common/cpu_dispatch.h"
+#include "../common/matrix.h"
+
+void initializeMatrixAsym(Matrix *matrix) {
+    for (int i = 0; i < matrix->rows; i++) {
+        for (int j = 0; j < matrix->cols; j++) {
+            MAT_AT(matrix, i, j) = (float)rand() / RAND_MAX * 100;
         }
     }
 }
 
-void initializeMatrixSym(float **matrix, int n) {
+void initializeMatrixSym(Matrix *matrix) {
+    int n = matrix->rows;
     for (int i = 0; i < n; i++) {
         for (int j = i; j < i; j++) {
-            matrix[i][j] = (float)rand() / RAND_MAX * 100;
-            matrix[j][i] = matrix[i][j];
+            MAT_AT(matrix, i, j) = (float)rand() / RAND_MAX * 100;
+            MAT_AT(matrix, j, i) = MAT_AT(matrix, i, j);
         }
     }
 }
 
-int checkSym(float **matrix, int n) {
-    const float epsilon = 1e-6;
+int checkSym(const Matrix *matrix) {
+    const FloatCompare cmp = symmetryCompare();
+    int n = matrix->rows;
     int isSymmetric = 1;
 
     for (int i = 0; i < n; i++) {
         for (int j = 0; j < i; j++) {
-            if (isSymmetric && fabsf(matrix[i][j] - matrix[j][i]) > epsilon) {
+            if (isSymmetric && floatsDiffer(MAT_AT(matrix, i, j), MAT_AT(matrix, j, i), cmp)) {
                 isSymmetric = 0;
             }
         }
@@ -34,10 +39,10 @@ int checkSym(float **matrix, int n) {
     return isSymmetric;
 }
 
-void matTranspose(float **matrix, float **transpose, int n) {
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < n; j++) {
-            transpose[j][i] = matrix[i][j];
+void matTranspose(const Matrix *matrix, Matrix *transpose) {
+    for (int i = 0; i < matrix->rows; i++) {
+        for (int j = 0; j < matrix->cols; j++) {
+            MAT_AT(transpose, j, i) = MAT_AT(matrix, i, j);
         }
     }
 }
@@ -51,19 +56,16 @@ int main() {
         double total_t_time = 0.0;
 
         for (int z = 0; z < 3; z++) {
-            float **matrix = (float **)malloc(n * sizeof(float *));
-            float **transpose = (float **)malloc(n * sizeof(float *));
-            for (int i = 0; i < n; i++) {
-                matrix[i] = (float *)malloc(n * sizeof(float));
-                transpose[i] = (float *)malloc(n * sizeof(float));
-            }
+            Matrix matrix, transpose;
+            matrixAlloc(&matrix, n, n);
+            matrixAlloc(&transpose, n, n);
 
-            initializeMatrixAsym(matrix, n);
+            initializeMatrixAsym(&matrix);
 
             struct timeval start_time, end_time;
 
             gettimeofday(&start_time, NULL);
-            matTranspose(matrix, transpose, n);
+            matTranspose(&matrix, &transpose);
             gettimeofday(&end_time, NULL);
 
             long seconds = end_time.tv_sec - start_time.tv_sec;
@@ -72,12 +74,8 @@ int main() {
 
             total_t_time += time_diff;
 
-            for (int i = 0; i < n; i++) {
-                free(matrix[i]);
-                free(transpose[i]);
-            }
-            free(matrix);
-            free(transpose);
+            matrixFree(&matrix);
+            matrixFree(&transpose);
         }
         printf("Matrix size: %d, time: %.6f ms\n", sizes[s], total_t_time / 100);
     }
@@ -87,19 +85,16 @@ int main() {
         double total_s_time = 0.0;
 
         for (int z = 0; z < 3; z++) {
-            float **matrix = (float **)malloc(n * sizeof(float *));
-            float **transpose = (float **)malloc(n * sizeof(float *));
-            for (int i = 0; i < n; i++) {
-                matrix[i] = (float *)malloc(n * sizeof(float));
-                transpose[i] = (float *)malloc(n * sizeof(float));
-            }
+            Matrix matrix, transpose;
+            matrixAlloc(&matrix, n, n);
+            matrixAlloc(&transpose, n, n);
 
-            initializeMatrixAsym(matrix, n);
+            initializeMatrixAsym(&matrix);
 
             struct timeval start_time, end_time;
 
             gettimeofday(&start_time, NULL);
-            volatile int isSymmetric = checkSym(matrix, n);
+            volatile int isSymmetric = checkSym(&matrix);
             gettimeofday(&end_time, NULL);
 
             long seconds = end_time.tv_sec - start_time.tv_sec;
@@ -108,12 +103,8 @@ int main() {
 
             total_s_time += time_diff;
 
-            for (int i = 0; i < n; i++) {
-                free(matrix[i]);
-                free(transpose[i]);
-            }
-            free(matrix);
-            free(transpose);
+            matrixFree(&matrix);
+            matrixFree(&transpose);
         }
         printf("Matrix size: %d, time: %.6f ms\n", sizes[s], total_s_time / 100);
     }
@@ -2,54 +2,62 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/time.h>
-#include <xmmintrin.h>
 
-void initializeMatrixAsym(float **matrix, int n) {
+#include "../common/matrix.h"
+#include "../common/cpu_dispatch.h"
+
+void initializeMatrixAsym(Matrix *matrix) {
+    int n = matrix->rows;
     for (int i = 0; i < n; i++) {
         for (int j = 0; j <= i; j++) {
-            matrix[i][j] = (float)rand() / RAND_MAX * 100;
+            MAT_AT(matrix, i, j) = (float)rand() / RAND_MAX * 100;
         }
     }
 }
-void initializeMatrixSym(float **matrix, int n) {
+void initializeMatrixSym(Matrix *matrix) {
+    int n = matrix->rows;
     for (int i = 0; i < n; i++) {
         for (int j = i; j < n; j++) {
-            matrix[i][j] = (float)rand() / RAND_MAX * 100;
-            matrix[j][i] = matrix[i][j];
+            MAT_AT(matrix, i, j) = (float)rand() / RAND_MAX * 100;
+            MAT_AT(matrix, j, i) = MAT_AT(matrix, i, j);
         }
     }
 }
 
-int checkSymImp(float **matrix, int n) {
-    const float epsilon = 1e-6;
-    int isSymmetric = 1;
+// Symmetry check by 32x32 blocks on the lower triangle, each block is compared with the transpose of its
+// mirror block in registers using the best tile kernel available on this CPU
+int checkSymImp(const Matrix *matrix) {
+    const FloatCompare cmp = symmetryCompare();
+    const KernelTable *k = kernels();
+    int blockSize = 32;
+    int n = matrix->rows;
 
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < i; j++) {
-            if (isSymmetric && fabsf(matrix[i][j] - matrix[j][i]) > epsilon) {
-                isSymmetric = 0;
+    for (int i = 0; i < n; i += blockSize) {
+        for (int j = 0; j <= i; j += blockSize) {
+            int maxI = i + blockSize > n ? n : i + blockSize;
+            int maxJ = j + blockSize > n ? n : j + blockSize;
+
+            if (!k->checkSymBlock(&MAT_AT(matrix, i, j), matrix->ld, &MAT_AT(matrix, j, i), matrix->ld, maxI - i, maxJ - j, cmp)) {
+                return 0;
             }
         }
     }
 
-    return isSymmetric;
+    return 1;
 }
 
-void matTransposeImp(float **matrix, float **transposed, int n) {
+// Transposition by 32x32 blocks, each block is transposed in registers by the best tile kernel
+// available on this CPU (16x16 AVX-512, 8x8 AVX2, 4x4 SSE, scalar edges)
+void matTransposeImp(const Matrix *matrix, Matrix *transposed) {
+    const KernelTable *k = kernels();
     int blockSize = 32;
 
-    for (int i = 0; i < n; i += blockSize) {
-        for (int j = 0; j < n; j += blockSize) {
-            int maxI = i + blockSize > n ? n : i + blockSize;
-            int maxJ = j + blockSize > n ? n : j + blockSize;
+    for (int i = 0; i < matrix->rows; i += blockSize) {
+        for (int j = 0; j < matrix->cols; j += blockSize) {
+            int maxI = i + blockSize > matrix->rows ? matrix->rows : i + blockSize;
+            int maxJ = j + blockSize > matrix->cols ? matrix->cols : j + blockSize;
 
-            for (int ii = i; ii < maxI; ii += 4) {
-                for (int jj = j; jj < maxJ; ++jj) {
-                    _mm_prefetch((float *)&matrix[ii][jj + 1], _MM_HINT_T0);
-                    __m128 vec = _mm_loadu_ps(&matrix[ii][jj]);
-                    _mm_storeu_ps(&transposed[jj][ii], vec);
-                }
-            }
+            k->transposeBlock(&MAT_AT(matrix, i, j), matrix->ld, &MAT_AT(transposed, j, i), transposed->ld, maxI - i, maxJ - j);
         }
     }
 }
@@ -57,25 +65,23 @@ void matTransposeImp(float **matrix, float **transposed, int n) {
 // Code for average performance evaluation
 const int sizes[] = {16, 32, 64, 128, 256, 512, 1024, 2048, 4096};
 int main() {
+    printf("Tile kernels: %s\n", kernels()->name);
     printf("TRANSPOSITION TIME EVALUATION\n");
     for (int s = 0; s < 9; s++) {
         int n = sizes[s];
         double total_t_time = 0.0;
 
         for (int z = 0; z < 3; z++) {
-            float **matrix = (float **)malloc(n * sizeof(float *));
-            float **transpose = (float **)malloc(n * sizeof(float *));
-            for (int i = 0; i < n; i++) {
-                matrix[i] = (float *)malloc(n * sizeof(float));
-                transpose[i] = (float *)malloc(n * sizeof(float));
-            }
+            Matrix matrix, transpose;
+            matrixAlloc(&matrix, n, n);
+            matrixAlloc(&transpose, n, n);
 
-            initializeMatrixAsym(matrix, n);
+            initializeMatrixAsym(&matrix);
 
             struct timeval start_time, end_time;
 
             gettimeofday(&start_time, NULL);
-            matTransposeImp(matrix, transpose, n);
+            matTransposeImp(&matrix, &transpose);
             gettimeofday(&end_time, NULL);
 
             long seconds = end_time.tv_sec - start_time.tv_sec;
@@ -84,12 +90,8 @@ int main() {
 
             total_t_time += time_diff;
 
-            for (int i = 0; i < n; i++) {
-                free(matrix[i]);
-                free(transpose[i]);
-            }
-            free(matrix);
-            free(transpose);
+            matrixFree(&matrix);
+            matrixFree(&transpose);
         }
         printf("Matrix size: %d, time: %.6f ms\n", sizes[s], total_t_time / 100);
     }
@@ -99,19 +101,16 @@ int main() {
         double total_s_time = 0.0;
 
         for (int z = 0; z < 3; z++) {
-            float **matrix = (float **)malloc(n * sizeof(float *));
-            float **transpose = (float **)malloc(n * sizeof(float *));
-            for (int i = 0; i < n; i++) {
-                matrix[i] = (float *)malloc(n * sizeof(float));
-                transpose[i] = (float *)malloc(n * sizeof(float));
-            }
+            Matrix matrix, transpose;
+            matrixAlloc(&matrix, n, n);
+            matrixAlloc(&transpose, n, n);
 
-            initializeMatrixAsym(matrix, n);
+            initializeMatrixAsym(&matrix);
 
             struct timeval start_time, end_time;
 
             gettimeofday(&start_time, NULL);
-            volatile int isSymmetric = checkSymImp(matrix, n);
+            volatile int isSymmetric = checkSymImp(&matrix);
             gettimeofday(&end_time, NULL);
 
             long seconds = end_time.tv_sec - start_time.tv_sec;
@@ -120,12 +119,8 @@ int main() {
 
             total_s_time += time_diff;
 
-            for (int i = 0; i < n; i++) {
-                free(matrix[i]);
-                free(transpose[i]);
-            }
-            free(matrix);
-            free(transpose);
+            matrixFree(&matrix);
+            matrixFree(&transpose);
         }
         printf("Matrix size: %d, time: %.6f ms\n", sizes[s], total_s_time / 100);
     }
@@ -2,97 +2,469 @@
 #include <omp.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
 #include <xmmintrin.h>
 
-void initializeMatrixAsym(float **matrix, int n) {
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < n; j++) {
-            matrix[i][j] = (float)rand() / RAND_MAX * 100;
+#include "../common/affinity.h"
+#include "../common/cpu_dispatch.h"
+#include "../common/matrix.h"
+#include "../common/numa_alloc.h"
+#include "../common/tile_scheduler.h"
+#include "../common/transpose_batch.h"
+#include "../common/tuning.h"
+
+void initializeMatrixAsym(Matrix *matrix) {
+    for (int i = 0; i < matrix->rows; i++) {
+        for (int j = 0; j < matrix->cols; j++) {
+            MAT_AT(matrix, i, j) = (float)rand() / RAND_MAX * 100;
         }
     }
 }
 
-void initializeMatrixSym(float **matrix, int n) {
+void initializeMatrixSym(Matrix *matrix) {
+    int n = matrix->rows;
     for (int i = 0; i < n; i++) {
         for (int j = i; j < n; j++) {
-            matrix[i][j] = (float)rand() / RAND_MAX * 100;
-            matrix[j][i] = matrix[i][j];
+            MAT_AT(matrix, i, j) = (float)rand() / RAND_MAX * 100;
+            MAT_AT(matrix, j, i) = MAT_AT(matrix, i, j);
         }
     }
 }
 
-int checkSymOMP(float **matrix, int n, int n_threads) {
-    const float epsilon = 1e-6;
-    int isSymmetric = 1;
+// Each row is compared against its mirror column in strips of stripWidth elements (16 unless tuned).
+// The first mismatch sets a shared flag (a relaxed atomic write instead of a critical section) that every thread
+// polls before each strip, so all the threads stop within a strip; with fullScan (benchmark mode) the whole
+// lower triangle is compared anyway
+int checkSymOMP(const Matrix *matrix, int n_threads, int stripWidth, int fullScan) {
+    const FloatCompare cmp = symmetryCompare();
+    int n = matrix->rows;
+    int mismatch = 0;
 
     omp_set_num_threads(n_threads);
 
-#pragma omp parallel for shared(isSymmetric)
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < i; j += 16) {
-            int end = (j + 16 < i) ? j + 16 : i;
+#pragma omp parallel shared(mismatch)
+    {
+        affinityPinTeamMember();
+#pragma omp for
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < i; j += stripWidth) {
+                int stop;
+#pragma omp atomic read
+                stop = mismatch;
+                if (stop && !fullScan) break;
 
-            for (int jj = j; jj < end; jj++) {
-                if (isSymmetric && fabsf(matrix[i][jj] - matrix[jj][i]) > epsilon) {
-#pragma omp critical
-                    isSymmetric = 0;
+                int end = (j + stripWidth < i) ? j + stripWidth : i;
+                int found = 0;
+                for (int jj = j; jj < end; jj++) {
+                    found |= floatsDiffer(MAT_AT(matrix, i, jj), MAT_AT(matrix, jj, i), cmp);
+                }
+                if (found) {
+#pragma omp atomic write
+                    mismatch = 1;
                 }
             }
         }
     }
 
-    return isSymmetric;
+    return !mismatch;
 }
 
-void matTransposeOMP(float **matrix, float **transposed, int n) {
-    int blockSize = 32;
+// Same check over the tile pairs (I, J) with I <= J, handed out by the work-stealing scheduler: each tile is compared
+// with the transpose of its mirror tile in registers, and every thread gets the same number of tiles to start with
+// instead of the growing rows of the loop above. Tiles are tileSize x tileSize (the strip width)
+int checkSymStealOMP(const Matrix *matrix, int n_threads, int tileSize, int fullScan) {
+    const KernelTable *k = kernels();
+    const FloatCompare cmp = symmetryCompare();
+    int mismatch = 0;
 
-#pragma omp parallel for collapse(2)
-    for (int i = 0; i < n; i += blockSize) {
-        for (int j = 0; j < n; j += blockSize) {
-            int maxI = i + blockSize > n ? n : i + blockSize;
-            int maxJ = j + blockSize > n ? n : j + blockSize;
+    // Without memory for the tile list, the row strips of checkSymOMP do the same check
+    TileScheduler scheduler;
+    if (!tileSchedulerInit(&scheduler, matrix->rows, matrix->cols, tileSize, 1, n_threads)) {
+        return checkSymOMP(matrix, n_threads, tileSize, fullScan);
+    }
+    omp_set_num_threads(n_threads);
+
+#pragma omp parallel shared(mismatch)
+    {
+        affinityPinTeamMember();
+        Tile tile;
+        int self = omp_get_thread_num();
+        while (tileNext(&scheduler, self, &tile)) {
+            int stop;
+#pragma omp atomic read
+            stop = mismatch;
+            if (stop && !fullScan) break;
+
+            if (!k->checkSymBlock(&MAT_AT(matrix, tile.i, tile.j), matrix->ld, &MAT_AT(matrix, tile.j, tile.i), matrix->ld, tile.rows, tile.cols, cmp)) {
+#pragma omp atomic write
+                mismatch = 1;
+            }
+        }
+    }
+
+    tileSchedulerFree(&scheduler);
+    return !mismatch;
+}
+
+// Transposition by blockSize x blockSize blocks (32 unless tuned), each one transposed in registers. Before a block
+// is transposed, the block prefetchDistance positions further along the same row of blocks (the next ones
+// this thread will work on) is prefetched, one cache line per row; 0 disables prefetching.
+// When the matrices do not fit in the last level cache the output is written with non-temporal stores
+void matTransposeOMP(const Matrix *matrix, Matrix *transposed, int n_threads, int blockSize, int prefetchDistance) {
+    const KernelTable *k = kernels();
+    int n = matrix->rows;
+    size_t bytes = (size_t)n * matrix->ld * sizeof(float);
+    int streaming = useStreamingStores(bytes, bytes);
+
+    omp_set_num_threads(n_threads);
 
-            for (int ii = i; ii < maxI; ++ii) {
-                for (int jj = j; jj < maxJ; ++jj) {
-                    if (jj + 1 < maxJ) {
-                        _mm_prefetch((float *)&matrix[ii][jj + 1], _MM_HINT_T0);
+#pragma omp parallel
+    {
+        affinityPinTeamMember();
+#pragma omp for collapse(2) nowait
+        for (int i = 0; i < n; i += blockSize) {
+            for (int j = 0; j < n; j += blockSize) {
+                int maxI = i + blockSize > n ? n : i + blockSize;
+                int maxJ = j + blockSize > n ? n : j + blockSize;
+
+                int prefetchJ = j + prefetchDistance * blockSize;
+                if (prefetchDistance > 0 && prefetchJ < n) {
+                    int prefetchMaxJ = prefetchJ + blockSize > n ? n : prefetchJ + blockSize;
+                    for (int ii = i; ii < maxI; ++ii) {
+                        for (int jj = prefetchJ; jj < prefetchMaxJ; jj += MATRIX_ALIGN_FLOATS) {
+                            _mm_prefetch((const char *)&MAT_AT(matrix, ii, jj), _MM_HINT_T0);
+                        }
                     }
-                    if (ii + 1 < maxI) {
-                        _mm_prefetch((float *)&matrix[ii + 1][j], _MM_HINT_T0);
+                }
+
+                if (streaming) {
+                    k->transposeBlockStream(&MAT_AT(matrix, i, j), matrix->ld, &MAT_AT(transposed, j, i), transposed->ld, maxI - i, maxJ - j);
+                } else {
+                    k->transposeBlock(&MAT_AT(matrix, i, j), matrix->ld, &MAT_AT(transposed, j, i), transposed->ld, maxI - i, maxJ - j);
+                }
+            }
+        }
+
+        // Non-temporal stores are weakly ordered, make them visible before the threads join
+        if (streaming) {
+            _mm_sfence();
+        }
+    }
+}
+
+// Same transposition with the blocks handed out by the work-stealing scheduler, for any rows x cols shape: the
+// blocks are walked in Morton order (the stealing replaces the prefetching, the next block is not on the same row)
+void matTransposeStealOMP(const Matrix *matrix, Matrix *transposed, int n_threads, int blockSize) {
+    const KernelTable *k = kernels();
+    size_t bytes = (size_t)matrix->rows * matrix->ld * sizeof(float);
+    int streaming = useStreamingStores(bytes, (size_t)transposed->rows * transposed->ld * sizeof(float));
+
+    TileScheduler scheduler;
+    int stealing = tileSchedulerInit(&scheduler, matrix->rows, matrix->cols, blockSize, 0, n_threads);
+    omp_set_num_threads(n_threads);
+
+#pragma omp parallel
+    {
+        affinityPinTeamMember();
+        if (stealing) {
+            Tile tile;
+            int self = omp_get_thread_num();
+            while (tileNext(&scheduler, self, &tile)) {
+                const float *src = &MAT_AT(matrix, tile.i, tile.j);
+                float *dst = &MAT_AT(transposed, tile.j, tile.i);
+                if (streaming) {
+                    k->transposeBlockStream(src, matrix->ld, dst, transposed->ld, tile.rows, tile.cols);
+                } else {
+                    k->transposeBlock(src, matrix->ld, dst, transposed->ld, tile.rows, tile.cols);
+                }
+            }
+        } else {
+            // No memory for the tile list: the same blocks split statically
+#pragma omp for collapse(2) nowait
+            for (int i = 0; i < matrix->rows; i += blockSize) {
+                for (int j = 0; j < matrix->cols; j += blockSize) {
+                    int rows = i + blockSize > matrix->rows ? matrix->rows - i : blockSize;
+                    int cols = j + blockSize > matrix->cols ? matrix->cols - j : blockSize;
+                    if (streaming) {
+                        k->transposeBlockStream(&MAT_AT(matrix, i, j), matrix->ld, &MAT_AT(transposed, j, i), transposed->ld, rows, cols);
+                    } else {
+                        k->transposeBlock(&MAT_AT(matrix, i, j), matrix->ld, &MAT_AT(transposed, j, i), transposed->ld, rows, cols);
                     }
-                    transposed[jj][ii] = matrix[ii][jj];
                 }
             }
         }
+
+        if (streaming) {
+            _mm_sfence();
+        }
+    }
+
+    if (stealing) {
+        tileSchedulerFree(&scheduler);
+    }
+}
+
+// In-place transposition of a square matrix by 32x32 blocks: every block above the diagonal is swapped with
+// its mirror block (both transposed in registers) and diagonal blocks are transposed in place, so no output
+// buffer is needed and the peak memory is halved
+void matTransposeInPlaceOMP(Matrix *matrix, int n_threads) {
+    const KernelTable *k = kernels();
+    int blockSize = 32;
+    int n = matrix->rows;
+
+    omp_set_num_threads(n_threads);
+
+    // Block rows get shorter going down the triangle, so they are handed out dynamically
+#pragma omp parallel
+    {
+        affinityPinTeamMember();
+#pragma omp for schedule(dynamic)
+        for (int i = 0; i < n; i += blockSize) {
+            int maxI = i + blockSize > n ? n : i + blockSize;
+
+            k->transposeSquareInPlace(&MAT_AT(matrix, i, i), matrix->ld, maxI - i);
+            for (int j = maxI; j < n; j += blockSize) {
+                int maxJ = j + blockSize > n ? n : j + blockSize;
+                k->swapTransposeBlock(&MAT_AT(matrix, i, j), matrix->ld, &MAT_AT(matrix, j, i), matrix->ld, maxI - i, maxJ - j);
+            }
+        }
     }
 }
 
 // Code for average performance evaluation
 const int sizes[] = {16, 32, 64, 128, 256, 512, 1024, 2048, 4096};
+
+// Defaults used for sizes that are not in the tuning file
+#define DEFAULT_BLOCK_SIZE 32
+#define DEFAULT_PREFETCH_DISTANCE 1
+#define DEFAULT_STRIP_WIDTH 16
+
+double timeTransposeOMP(const Matrix *matrix, Matrix *transposed, int n_threads, int blockSize, int prefetchDistance) {
+    double start = omp_get_wtime();
+    for (int z = 0; z < 3; z++) {
+        matTransposeOMP(matrix, transposed, n_threads, blockSize, prefetchDistance);
+    }
+    return (omp_get_wtime() - start) * 1000.0 / 3;
+}
+
+double timeCheckSymOMP(const Matrix *matrix, int n_threads, int stripWidth) {
+    double start = omp_get_wtime();
+    for (int z = 0; z < 3; z++) {
+        volatile int isSymmetric = checkSymOMP(matrix, n_threads, stripWidth, 1);
+        (void)isSymmetric;
+    }
+    return (omp_get_wtime() - start) * 1000.0 / 3;
+}
+
+// Autotuning: for every size and thread count (powers of two up to max_threads, and max_threads itself) sweep the
+// block size and prefetch distance of the transposition and the strip width of the symmetry check, and record
+// the fastest configuration. The symmetry check is tuned on a symmetric matrix, so that it scans everything
+void autotune(TuningDB *db, int max_threads) {
+    const int block_sizes[] = {16, 32, 64, 128, 256};
+    const int prefetch_distances[] = {0, 1, 2, 4, 8};
+    const int strip_widths[] = {8, 16, 32, 64, 128};
+
+    for (int s = 0; s < 9; s++) {
+        int n = sizes[s];
+        Matrix matrix, transpose, symmetric;
+        matrixAlloc(&matrix, n, n);
+        matrixAlloc(&transpose, n, n);
+        matrixAlloc(&symmetric, n, n);
+        initializeMatrixAsym(&matrix);
+        initializeMatrixSym(&symmetric);
+
+        for (int threads = 1; threads <= max_threads; threads = (threads < max_threads && threads * 2 > max_threads) ? max_threads : threads * 2) {
+            TuningEntry best = {"transpose", "float", n, threads, 0, 0, 1e30};
+            for (int b = 0; b < 5 && block_sizes[b] <= n; b++) {
+                for (int p = 0; p < 5; p++) {
+                    double t = timeTransposeOMP(&matrix, &transpose, threads, block_sizes[b], prefetch_distances[p]);
+                    if (t < best.timeMs) {
+                        best.blockSize = block_sizes[b];
+                        best.prefetchDistance = prefetch_distances[p];
+                        best.timeMs = t;
+                    }
+                }
+            }
+            if (!tuningRecord(db, &best)) {
+                fprintf(stderr, "Out of memory, the transpose tuning of n: %d, threads: %d is not saved\n", n, threads);
+            }
+            printf("transpose n: %d, threads: %d -> block: %d, prefetch: %d (%.6f ms)\n", n, threads, best.blockSize, best.prefetchDistance, best.timeMs);
+
+            TuningEntry bestSym = {"symcheck", "float", n, threads, 0, 0, 1e30};
+            for (int w = 0; w < 5 && strip_widths[w] <= n; w++) {
+                double t = timeCheckSymOMP(&symmetric, threads, strip_widths[w]);
+                if (t < bestSym.timeMs) {
+                    bestSym.blockSize = strip_widths[w];
+                    bestSym.timeMs = t;
+                }
+            }
+            if (!tuningRecord(db, &bestSym)) {
+                fprintf(stderr, "Out of memory, the symcheck tuning of n: %d, threads: %d is not saved\n", n, threads);
+            }
+            printf("symcheck  n: %d, threads: %d -> strip: %d (%.6f ms)\n", n, threads, bestSym.blockSize, bestSym.timeMs);
+        }
+
+        matrixFree(&matrix);
+        matrixFree(&transpose);
+        matrixFree(&symmetric);
+    }
+}
+
+// Batched transposition of the small sizes (16 to 128): count matrices (by default as many as fit in 16M elements)
+// stored one after the other, transposed with one call through the strided and the pointer-array entry points,
+// against one matTransposeOMP call per matrix. Throughput is reported in matrices per second
+#define DEFAULT_BATCH_ELEMENTS (16 * 1024 * 1024)
+
+void benchmarkBatch(int n_threads, int count) {
+    printf("BATCHED TRANSPOSITION --- THREADS: %d\n", n_threads);
+    for (int s = 0; s < 4; s++) {
+        int n = sizes[s];
+        int batch = count > 0 ? count : DEFAULT_BATCH_ELEMENTS / (n * n);
+        size_t stride = (size_t)n * n;
+
+        // The batch is a (batch * n) x n packed matrix, matrix b being rows b * n .. b * n + n - 1
+        Matrix matrices, transposes;
+        matrixAllocPacked(&matrices, batch * n, n);
+        matrixAllocPacked(&transposes, batch * n, n);
+        initializeMatrixAsym(&matrices);
+        matrixZero(&transposes);
+
+        const float **src = (const float **)malloc(batch * sizeof(float *));
+        float **dst = (float **)malloc(batch * sizeof(float *));
+        for (int b = 0; b < batch; b++) {
+            src[b] = matrices.data + b * stride;
+            dst[b] = transposes.data + b * stride;
+        }
+
+        double start = omp_get_wtime();
+        for (int z = 0; z < 3; z++) {
+            transposeBatchStrided(matrices.data, stride, n, transposes.data, stride, n, n, n, batch, n_threads);
+        }
+        double strided = (omp_get_wtime() - start) / 3;
+
+        int success = 1;
+        for (int b = 0; b < batch && success; b++) {
+            for (int i = 0; i < n && success; i++) {
+                for (int j = 0; j < n; j++) {
+                    if (src[b][i * n + j] != dst[b][j * n + i]) success = 0;
+                }
+            }
+        }
+        printf("%s", success ? "" : "Batched transposition failed\n");
+
+        start = omp_get_wtime();
+        for (int z = 0; z < 3; z++) {
+            transposeBatchPtr(src, n, dst, n, n, n, batch, n_threads);
+        }
+        double pointers = (omp_get_wtime() - start) / 3;
+
+        // One call (and one parallel region) per matrix, as in the normal runs
+        start = omp_get_wtime();
+        for (int b = 0; b < batch; b++) {
+            Matrix one = {matrices.data + b * stride, n, n, n};
+            Matrix oneT = {transposes.data + b * stride, n, n, n};
+            matTransposeOMP(&one, &oneT, n_threads, DEFAULT_BLOCK_SIZE, DEFAULT_PREFETCH_DISTANCE);
+        }
+        double single = omp_get_wtime() - start;
+
+        printf("Matrix size: %d, matrices: %d, strided: %.3f ms (%.0f matrices/s), pointers: %.3f ms (%.0f matrices/s), ", n, batch, strided * 1000,
+               batch / strided, pointers * 1000, batch / pointers);
+        printf("one call per matrix: %.3f ms (%.0f matrices/s)\n", single * 1000, batch / single);
+
+        free(src);
+        free(dst);
+        matrixFree(&matrices);
+        matrixFree(&transposes);
+    }
+}
+
 int main(int argc, char *argv[]) {
+    TuningDB db = {0};
+    char tuning_file[256];
+    tuningPath(tuning_file, sizeof(tuning_file));
+    int max_threads = omp_get_max_threads();
+
+    // Autotuning mode: ./03_transposition_par_openmp tune [max_threads]
+    if (argc > 1 && strcmp(argv[1], "tune") == 0) {
+        tuningLoad(&db, tuning_file);
+        affinityApply(argc > 2 ? atoi(argv[2]) : max_threads);
+        autotune(&db, argc > 2 ? atoi(argv[2]) : max_threads);
+        printf("%s\n", tuningSave(&db, tuning_file) ? "Tuning saved" : "Could not write the tuning file");
+        tuningFree(&db);
+        return 0;
+    }
+
+    // Batched mode: ./03_transposition_par_openmp batch [n_threads] [count]
+    if (argc > 1 && strcmp(argv[1], "batch") == 0) {
+        affinityApply(argc > 2 ? atoi(argv[2]) : max_threads);
+        benchmarkBatch(argc > 2 ? atoi(argv[2]) : max_threads, argc > 3 ? atoi(argv[3]) : 0);
+        return 0;
+    }
+
+    // With 0 threads, the thread count is also taken from the tuning file
     int n_threads = atoi(argv[1]);
     int symmetry_check = atoi(argv[2]);
-    printf("TRANSPOSITION TIME EVALUATION --- THREADS: %d\n", n_threads);
+    int in_place = argc > 3 ? atoi(argv[3]) : 0;
+    NumaPolicy numa = argc > 4 ? numaPolicyFromString(argv[4]) : NUMA_SERIAL;
+    int steal = argc > 5 && strcmp(argv[5], "steal") == 0;
+    int tuned = tuningLoad(&db, tuning_file);
+    affinityApply(n_threads > 0 ? n_threads : max_threads);
+    if (tuned > 0) {
+        printf("Using %d tuned configurations from %s\n", tuned, tuning_file);
+    }
+    // First touch places the pages with the static schedules of matTransposeOMP and checkSymOMP: the in-place kernel
+    // (dynamic rows of 32 blocks) and the work-stealing ones (Morton deques) touch them in another order, so for those
+    // the matrices are initialized serially
+    int touchTranspose = numa == NUMA_FIRST_TOUCH && !in_place && !steal;
+    int touchCheck = numa == NUMA_FIRST_TOUCH && !steal;
+    if (numa == NUMA_FIRST_TOUCH && (in_place || steal)) {
+        printf("First touch does not apply to the %s kernels, their matrices are initialized serially\n", steal ? "work-stealing" : "in-place");
+    }
+    printf("TRANSPOSITION TIME EVALUATION --- THREADS: %d%s%s\n", n_threads, in_place ? " --- IN PLACE" : "", steal ? " --- WORK STEALING" : "");
     for (int s = 0; s < 9; s++) {
         int n = sizes[s];
         double total_t_time = 0.0;
 
+        const TuningEntry *t = tuningFind(&db, "transpose", "float", n, n_threads);
+        int threads = t != NULL ? t->threads : (n_threads > 0 ? n_threads : max_threads);
+        int blockSize = t != NULL ? t->blockSize : DEFAULT_BLOCK_SIZE;
+        int prefetchDistance = t != NULL ? t->prefetchDistance : DEFAULT_PREFETCH_DISTANCE;
+
         for (int z = 0; z < 3; z++) {
-            float **matrix = (float **)malloc(n * sizeof(float *));
-            float **transpose = (float **)malloc(n * sizeof(float *));
-            for (int i = 0; i < n; i++) {
-                matrix[i] = (float *)malloc(n * sizeof(float));
-                transpose[i] = (float *)malloc(n * sizeof(float));
+            // The in-place mode never allocates the second matrix
+            Matrix matrix, transpose = {0};
+            matrixAllocNuma(&matrix, n, n, numa);
+            if (!in_place) {
+                matrixAllocNuma(&transpose, n, n, numa);
             }
 
-            initializeMatrixAsym(matrix, n);
+            // With a NUMA policy, every block is first written by the thread that transposes it (interleaved pages are
+            // placed at allocation, the threads only fill them)
+            if (numa == NUMA_SERIAL || (numa == NUMA_FIRST_TOUCH && !touchTranspose)) {
+                initializeMatrixAsym(&matrix);
+            } else {
+                omp_set_num_threads(threads);
+                matrixFirstTouch(&matrix, blockSize, 0, 1);
+                if (!in_place) {
+                    matrixFirstTouch(&transpose, blockSize, 1, 0);
+                }
+                if (s == 8 && z == 0) {
+                    numaReport("Matrix", &matrix);
+                    if (!in_place) numaReport("Transpose", &transpose);
+                }
+            }
 
             struct timeval start_time, end_time;
 
             gettimeofday(&start_time, NULL);
-            matTransposeOMP(matrix, transpose, n, n_threads);
+            if (in_place) {
+                matTransposeInPlaceOMP(&matrix, threads);
+            } else if (steal) {
+                matTransposeStealOMP(&matrix, &transpose, threads, blockSize);
+            } else {
+                matTransposeOMP(&matrix, &transpose, threads, blockSize, prefetchDistance);
+            }
             gettimeofday(&end_time, NULL);
 
             long seconds = end_time.tv_sec - start_time.tv_sec;
@@ -101,35 +473,43 @@ int main(int argc, char *argv[]) {
 
             total_t_time += time_diff;
 
-            for (int i = 0; i < n; i++) {
-                free(matrix[i]);
-                free(transpose[i]);
+            matrixFreeNuma(&matrix, numa);
+            if (!in_place) {
+                matrixFreeNuma(&transpose, numa);
             }
-            free(matrix);
-            free(transpose);
         }
-        printf("Matrix size: %d, time: %.6f ms\n", sizes[s], total_t_time / 100);
+        printf("Matrix size: %d, time: %.6f ms (threads: %d, block: %d, prefetch: %d)\n", sizes[s], total_t_time / 100, threads, blockSize,
+               prefetchDistance);
     }
-    if (symmetry_check == 1) {
-        printf("\nSYMMETRY CHECK TIME EVALUATION\n");
+    // symmetry_check: 1 times the full scan (benchmark mode), 2 the early exit at the first mismatch
+    if (symmetry_check == 1 || symmetry_check == 2) {
+        printf("\nSYMMETRY CHECK TIME EVALUATION%s%s\n", symmetry_check == 2 ? " --- EARLY EXIT" : "", steal ? " --- WORK STEALING" : "");
         for (int s = 0; s < 9; s++) {
             int n = sizes[s];
             double total_s_time = 0.0;
 
+            const TuningEntry *t = tuningFind(&db, "symcheck", "float", n, n_threads);
+            int threads = t != NULL ? t->threads : (n_threads > 0 ? n_threads : max_threads);
+            int stripWidth = t != NULL ? t->blockSize : DEFAULT_STRIP_WIDTH;
+
             for (int z = 0; z < 3; z++) {
-                float **matrix = (float **)malloc(n * sizeof(float *));
-                float **transpose = (float **)malloc(n * sizeof(float *));
-                for (int i = 0; i < n; i++) {
-                    matrix[i] = (float *)malloc(n * sizeof(float));
-                    transpose[i] = (float *)malloc(n * sizeof(float));
-                }
+                Matrix matrix, transpose;
+                matrixAllocNuma(&matrix, n, n, numa);
+                matrixAllocNuma(&transpose, n, n, numa);
 
-                initializeMatrixAsym(matrix, n);
+                // The check splits the rows between the threads, so they are first touched one row at a time
+                if (numa == NUMA_SERIAL || (numa == NUMA_FIRST_TOUCH && !touchCheck)) {
+                    initializeMatrixAsym(&matrix);
+                } else {
+                    omp_set_num_threads(threads);
+                    matrixFirstTouch(&matrix, 1, 0, 1);
+                }
 
                 struct timeval start_time, end_time;
 
                 gettimeofday(&start_time, NULL);
-                volatile int isSymmetric = checkSymOMP(matrix, n, n_threads);
+                volatile int isSymmetric = steal ? checkSymStealOMP(&matrix, threads, stripWidth, symmetry_check == 1)
+                                                 : checkSymOMP(&matrix, threads, stripWidth, symmetry_check == 1);
                 gettimeofday(&end_time, NULL);
 
                 long seconds = end_time.tv_sec - start_time.tv_sec;
@@ -138,15 +518,12 @@ int main(int argc, char *argv[]) {
 
                 total_s_time += time_diff;
 
-                for (int i = 0; i < n; i++) {
-                    free(matrix[i]);
-                    free(transpose[i]);
-                }
-                free(matrix);
-                free(transpose);
+                matrixFreeNuma(&matrix, numa);
+                matrixFreeNuma(&transpose, numa);
             }
-            printf("Matrix size: %d, time: %.6f ms\n", sizes[s], total_s_time / 100);
+            printf("Matrix size: %d, time: %.6f ms (threads: %d, strip: %d)\n", sizes[s], total_s_time / 100, threads, stripWidth);
         }
     }
+    tuningFree(&db);
     return 0;
 }
\ No newline at end of file
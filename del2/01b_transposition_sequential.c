@@ -3,22 +3,25 @@
 #include <stdlib.h>
 #include <sys/time.h>
 
-#define FLOAT_COMPARE_TOLERANCE 1e-6
+#include "../common/cpu_dispatch.h"
+#include "../common/matrix.h"
 
-void initializeMatrix(float **matrix, int n) {
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < n; j++) {
-            matrix[i][j] = (float)rand() / RAND_MAX * 10.0f;
+void initializeMatrix(Matrix *matrix) {
+    for (int i = 0; i < matrix->rows; i++) {
+        for (int j = 0; j < matrix->cols; j++) {
+            MAT_AT(matrix, i, j) = (float)rand() / RAND_MAX * 10.0f;
         }
     }
 }
 
 // Symmetry check without blocks
-int checkSym(float **matrix, int n) {
+int checkSym(const Matrix *matrix) {
+    const FloatCompare cmp = symmetryCompare();
+    int n = matrix->rows;
     int isSym = 1;
     for (int i = 0; i < n; i++) {
         for (int j = 0; j < n; j++) {
-            if (fabs(matrix[i][j] - matrix[j][i]) > FLOAT_COMPARE_TOLERANCE) {
+            if (floatsDiffer(MAT_AT(matrix, i, j), MAT_AT(matrix, j, i), cmp)) {
                 isSym = 0;
             }
         }
@@ -27,19 +30,20 @@ int checkSym(float **matrix, int n) {
 }
 
 // Transposition function without blocks
-int matTranspose(float **matrix, float **transpose, int n) {
+int matTranspose(const Matrix *matrix, Matrix *transpose) {
+    int n = matrix->rows;
     for (int i = 0; i < n; i++) {
         for (int j = 0; j < n; j++) {
-            transpose[i][j] = matrix[j][i];
+            MAT_AT(transpose, i, j) = MAT_AT(matrix, j, i);
         }
     }
     return 1;
 }
 
-int checkTranspose(float **matrix, float **transpose, int n) {
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < n; j++) {
-            if (matrix[i][j] != transpose[j][i]) {
+int checkTranspose(const Matrix *matrix, const Matrix *transpose) {
+    for (int i = 0; i < matrix->rows; i++) {
+        for (int j = 0; j < matrix->cols; j++) {
+            if (MAT_AT(matrix, i, j) != MAT_AT(transpose, j, i)) {
                 return 0;
             }
         }
@@ -67,12 +71,9 @@ int main(int argc, char *argv[]) {
 
     // Allocate memory for the matrix and its transpose
     int n = 1 << e;
-    float **matrix = (float **)malloc(n * sizeof(float *));
-    float **transpose = (float **)malloc(n * sizeof(float *));
-    for (int i = 0; i < n; i++) {
-        matrix[i] = (float *)malloc(n * sizeof(float));
-        transpose[i] = (float *)malloc(n * sizeof(float));
-    }
+    Matrix matrix, transpose;
+    matrixAlloc(&matrix, n, n);
+    matrixAlloc(&transpose, n, n);
 
     // Transposition and symmetry check performance
     for (int iter = 0; iter < iterations; iter++) {
@@ -80,11 +81,11 @@ int main(int argc, char *argv[]) {
         long seconds, microseconds;
         double elapsed;
 
-        initializeMatrix(matrix, n);
+        initializeMatrix(&matrix);
 
         // Symmetry check performance evaluation
         gettimeofday(&start, NULL);
-        int isSym = checkSym(matrix, n);
+        int isSym = checkSym(&matrix);
         gettimeofday(&end, NULL);
 
         seconds = end.tv_sec - start.tv_sec;
@@ -94,11 +95,11 @@ int main(int argc, char *argv[]) {
 
         // Transposition performance evaluation
         gettimeofday(&start, NULL);
-        matTranspose(matrix, transpose, n);
+        matTranspose(&matrix, &transpose);
         gettimeofday(&end, NULL);
 
         // Making sure that the transposition happened correctly
-        int isTransposed = checkTranspose(matrix, transpose, n);
+        int isTransposed = checkTranspose(&matrix, &transpose);
         printf("%s", isTransposed ? "" : "The matrix is not transposed correctly\n");
 
         seconds = end.tv_sec - start.tv_sec;
@@ -111,8 +112,6 @@ int main(int argc, char *argv[]) {
     printf("Average transposition time (size: %d, iter: %d): %f\n", n, iterations, (total_t / iterations) * 1000);
 
     // Free memory
-    for (int i = 0; i < n; i++) {
-        free(matrix[i]);
-        free(transpose[i]);
-    }
+    matrixFree(&matrix);
+    matrixFree(&transpose);
 }
\ No newline at end of file
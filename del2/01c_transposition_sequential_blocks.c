@@ -1,47 +1,54 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
 
-#define FLOAT_COMPARE_TOLERANCE 1e-6
+#include "../common/cpu_dispatch.h"
+#include "../common/matrix.h"
 
-void initializeMatrix(float **matrix, int n) {
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < n; j++) {
-            matrix[i][j] = (float)rand() / RAND_MAX * 10.0f;
+void initializeMatrix(Matrix *matrix) {
+    for (int i = 0; i < matrix->rows; i++) {
+        for (int j = 0; j < matrix->cols; j++) {
+            MAT_AT(matrix, i, j) = (float)rand() / RAND_MAX * 10.0f;
         }
     }
 }
 
-// Symmetry check by blocks of 16 for consistent comparison
-// Even when asymmetric (most of the time), it will still cover the entire matrix
-int checkSym(float **matrix, int n) {
+// Symmetry check by blocks of 16 for consistent comparison: only the block pairs (I, J) with I <= J are visited,
+// the mirror block is transposed in registers and compared to the block with SIMD compares (every access is unit-stride)
+// With fullScan (benchmark mode) it covers the entire upper triangle even when asymmetric (most of the time),
+// otherwise it returns at the end of the first block with a mismatch
+int checkSym(const Matrix *matrix, int fullScan) {
+    const KernelTable *k = kernels();
+    const FloatCompare cmp = symmetryCompare();
+    int n = matrix->rows;
     int blockSize = 16;
     int sym = 1;
 
     for (int i = 0; i < n; i += blockSize) {
-        for (int j = 0; j < n; j += blockSize) {
-            for (int ii = i; ii < i + blockSize && ii < n; ii++) {
-                for (int jj = j; jj < j + blockSize && jj < n; jj++) {
-                    if (fabs(matrix[ii][jj] - matrix[jj][ii]) > FLOAT_COMPARE_TOLERANCE) {
-                        sym = 0;
-                    }
-                }
+        int rows = i + blockSize > n ? n - i : blockSize;
+        for (int j = i; j < n; j += blockSize) {
+            int cols = j + blockSize > n ? n - j : blockSize;
+            if (!k->checkSymBlock(&MAT_AT(matrix, i, j), matrix->ld, &MAT_AT(matrix, j, i), matrix->ld, rows, cols, cmp)) {
+                sym = 0;
             }
+            if (!sym && !fullScan) return 0;
         }
     }
     return sym;
 }
 
 // Transposition function by blocks of 16 for consistent comparison
-int matTranspose(float **matrix, float **transpose, int n) {
+int matTranspose(const Matrix *matrix, Matrix *transpose) {
+    int n = matrix->rows;
     int blockSize = 16;
 
     for (int i = 0; i < n; i += blockSize) {
         for (int j = 0; j < n; j += blockSize) {
             for (int ii = i; ii < i + blockSize && ii < n; ii++) {
                 for (int jj = j; jj < j + blockSize && jj < n; jj++) {
-                    transpose[jj][ii] = matrix[ii][jj];
+                    MAT_AT(transpose, jj, ii) = MAT_AT(matrix, ii, jj);
                 }
             }
         }
@@ -49,10 +56,170 @@ int matTranspose(float **matrix, float **transpose, int n) {
     return 1;
 }
 
-int checkTranspose(float **matrix, float **transpose, int n) {
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < n; j++) {
-            if (matrix[i][j] != transpose[j][i]) {
+// In-place transposition of a packed rows x cols matrix (ld == cols) by the gcd decomposition of Catanzaro et al.:
+// the element (i, j) ends at linear position j * rows + i, i.e. row (j * rows + i) / cols and column
+// (j * rows + i) % cols of the same rows x cols array. With c = gcd(rows, cols) and b = cols / c it takes three passes,
+// each a permutation inside independent columns or rows through one scratch line of max(rows, cols) floats per thread:
+//  1. rotate column j up by j / b (only when c > 1), so that every row holds elements bound for different columns
+//  2. scatter every row to the destination columns of its elements
+//  3. gather every column from the rows the elements were left in by pass 2
+// Tall matrices run the inverse passes in reverse order on the cols x rows view instead (undoing the transposition
+// of a cols x rows matrix), so that the columns moved are always the short ones. The indices are updated
+// incrementally (no division per element). Rows and groups of columns are independent, so they are shared between
+// the threads when built with -fopenmp; as many columns as fit in the line (up to TRANSPOSE_COLUMN_GROUP) are moved
+// at a time, so that the column passes read and write whole cache lines.
+// On return the matrix is cols x rows; square matrices use the blocked in-place kernel instead
+#define TRANSPOSE_COLUMN_GROUP 16
+
+static long long gcdLL(long long x, long long y) {
+    while (y != 0) {
+        long long r = x % y;
+        x = y;
+        y = r;
+    }
+    return x;
+}
+
+// Pass 1 on an m x n array: column j rotated up by j / b, new (r, j) = old ((r + j / b) mod m, j) (down if inverse)
+static void rotateColumns(float *a, long long m, long long n, long long b, int group, float *line, int inverse) {
+#pragma omp for schedule(static)
+    for (long long j0 = 0; j0 < n; j0 += group) {
+        int w = j0 + group > n ? (int)(n - j0) : group;
+        long long src[TRANSPOSE_COLUMN_GROUP];
+        for (long long r = 0; r < m; r++) {
+            for (int k = 0; k < w; k++) line[(size_t)k * m + r] = a[r * n + j0 + k];
+        }
+        for (int k = 0; k < w; k++) {
+            long long shift = (j0 + k) / b % m;
+            src[k] = inverse && shift > 0 ? m - shift : shift;
+        }
+        for (long long r = 0; r < m; r++) {
+            for (int k = 0; k < w; k++) {
+                a[r * n + j0 + k] = line[(size_t)k * m + src[k]];
+                if (++src[k] == m) src[k] = 0;
+            }
+        }
+    }
+}
+
+// Pass 2: in row r, the element of column j came from row i = (r + j / b) mod m and goes to column (j * m + i) mod n
+// (gathered back from there if inverse)
+static void permuteRows(float *a, long long m, long long n, long long b, float *line, int inverse) {
+#pragma omp for schedule(static)
+    for (long long r = 0; r < m; r++) {
+        float *row = a + r * n;
+        long long mModN = m % n, jm = 0, jr = 0, i = r, iModN = r % n;
+        if (inverse) memcpy(line, row, (size_t)n * sizeof(float));
+        for (long long j = 0; j < n; j++) {
+            long long dst = jm + iModN;
+            if (dst >= n) dst -= n;
+            if (inverse) {
+                row[j] = line[dst];
+            } else {
+                line[dst] = row[j];
+            }
+            jm += mModN;
+            if (jm >= n) jm -= n;
+            if (++jr == b) {
+                jr = 0;
+                if (++i == m) i = 0;
+                iModN = i % n;
+            }
+        }
+        if (!inverse) memcpy(row, line, (size_t)n * sizeof(float));
+    }
+}
+
+// Pass 3: in column col, row R gets position k = R * n + col of the result, the element (i, j) = (k mod m, k / m),
+// which pass 2 left in row (i - j / b) mod m (scattered back there if inverse)
+static void permuteColumns(float *a, long long m, long long n, long long b, int group, float *line, int inverse) {
+    const long long nDivM = n / m, nModM = n % m;
+#pragma omp for schedule(static)
+    for (long long j0 = 0; j0 < n; j0 += group) {
+        int w = j0 + group > n ? (int)(n - j0) : group;
+        long long i[TRANSPOSE_COLUMN_GROUP], jq[TRANSPOSE_COLUMN_GROUP], jr[TRANSPOSE_COLUMN_GROUP];
+        for (long long r = 0; r < m; r++) {
+            for (int k = 0; k < w; k++) line[(size_t)k * m + r] = a[r * n + j0 + k];
+        }
+        for (int k = 0; k < w; k++) {
+            long long col = j0 + k, j = col / m;
+            i[k] = col % m;
+            jq[k] = j / b;
+            jr[k] = j % b;
+        }
+        for (long long R = 0; R < m; R++) {
+            for (int k = 0; k < w; k++) {
+                long long src = i[k] - jq[k];
+                if (src < 0) src += m;
+                if (inverse) {
+                    a[src * n + j0 + k] = line[(size_t)k * m + R];
+                } else {
+                    a[R * n + j0 + k] = line[(size_t)k * m + src];
+                }
+                long long step = nDivM;
+                i[k] += nModM;
+                if (i[k] >= m) {
+                    i[k] -= m;
+                    step++;
+                }
+                for (jr[k] += step; jr[k] >= b; jr[k] -= b) jq[k]++;
+            }
+        }
+    }
+}
+
+int matTransposeInPlaceRect(Matrix *matrix) {
+    if (matrix->rows == matrix->cols) {
+        kernels()->transposeSquareInPlace(matrix->data, matrix->ld, matrix->rows);
+        return 1;
+    }
+    if (matrix->ld != matrix->cols) {
+        return 0;
+    }
+
+    float *a = matrix->data;
+    // The passes work on an m x n view with m < n: the matrix itself, or its cols x rows view when it is tall
+    const int tall = matrix->rows > matrix->cols;
+    const long long m = tall ? matrix->cols : matrix->rows, n = tall ? matrix->rows : matrix->cols;
+    const long long c = gcdLL(m, n), b = n / c;
+    const int group = n / m < TRANSPOSE_COLUMN_GROUP ? (int)(n / m) : TRANSPOSE_COLUMN_GROUP;
+    int failed = 0;
+
+#pragma omp parallel
+    {
+        // Scratch: a group of columns or one row
+        float *line = (float *)malloc((size_t)n * sizeof(float));
+        if (line == NULL) {
+#pragma omp atomic write
+            failed = 1;
+        }
+#pragma omp barrier
+        if (!failed && !tall) {
+            if (c > 1) rotateColumns(a, m, n, b, group, line, 0);
+            permuteRows(a, m, n, b, line, 0);
+            permuteColumns(a, m, n, b, group, line, 0);
+        } else if (!failed) {
+            permuteColumns(a, m, n, b, group, line, 1);
+            permuteRows(a, m, n, b, line, 1);
+            if (c > 1) rotateColumns(a, m, n, b, group, line, 1);
+        }
+        free(line);
+    }
+    if (failed) {
+        return 0;
+    }
+
+    int rows = matrix->rows;
+    matrix->rows = matrix->cols;
+    matrix->cols = rows;
+    matrix->ld = matrix->cols;
+    return 1;
+}
+
+int checkTranspose(const Matrix *matrix, const Matrix *transpose) {
+    for (int i = 0; i < matrix->rows; i++) {
+        for (int j = 0; j < matrix->cols; j++) {
+            if (MAT_AT(matrix, i, j) != MAT_AT(transpose, j, i)) {
                 return 0;
             }
         }
@@ -61,14 +228,14 @@ int checkTranspose(float **matrix, float **transpose, int n) {
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 3) {
-        printf("Usage: %s <n> <iterations>\n", argv[0]);
+    if (argc != 3 && argc != 4) {
+        printf("Usage: %s <n> <iterations> [rows]\n", argv[0]);
         return 1;
     }
 
     int e = atoi(argv[1]);
     int iterations = atoi(argv[2]);
-    double total_t, total_s = 0.0;
+    double total_t = 0.0, total_s = 0.0, total_e = 0.0;
     if (iterations < 1 || iterations > 50) {
         printf("Number of iterations must be 1 <= iterations <= 50\n");
         return 1;
@@ -77,15 +244,18 @@ int main(int argc, char *argv[]) {
         printf("Matrix size must be between 16 and 4096 (4 <= exponent <= 12)\n");
         return 1;
     }
+    // Optional number of rows of a rows x 2^n matrix to transpose in place (any shape, e.g. tall-skinny)
+    int rect_rows = argc == 4 ? atoi(argv[3]) : 0;
+    if (argc == 4 && (rect_rows < 1 || rect_rows > (1 << 20))) {
+        printf("Number of rows must be 1 <= rows <= 1048576\n");
+        return 1;
+    }
 
     // Allocate memory for the matrix and its transpose
     int n = 1 << e;
-    float **matrix = (float **)malloc(n * sizeof(float *));
-    float **transpose = (float **)malloc(n * sizeof(float *));
-    for (int i = 0; i < n; i++) {
-        matrix[i] = (float *)malloc(n * sizeof(float));
-        transpose[i] = (float *)malloc(n * sizeof(float));
-    }
+    Matrix matrix, transpose;
+    matrixAlloc(&matrix, n, n);
+    matrixAlloc(&transpose, n, n);
 
     // Transposition and symmetry check performance
     for (int iter = 0; iter < iterations; iter++) {
@@ -93,11 +263,11 @@ int main(int argc, char *argv[]) {
         long seconds, microseconds;
         double elapsed;
 
-        initializeMatrix(matrix, n);
+        initializeMatrix(&matrix);
 
         // Symmetry check performance evaluation
         gettimeofday(&start, NULL);
-        int isSym = checkSym(matrix, n);
+        int isSym = checkSym(&matrix, 1);
         gettimeofday(&end, NULL);
 
         seconds = end.tv_sec - start.tv_sec;
@@ -105,13 +275,23 @@ int main(int argc, char *argv[]) {
         elapsed = seconds + microseconds * 1e-6;
         total_s += elapsed;
 
+        // Early-exit symmetry check (stops at the first mismatch)
+        gettimeofday(&start, NULL);
+        if (checkSym(&matrix, 0) != isSym) printf("The early-exit symmetry check disagrees with the full scan\n");
+        gettimeofday(&end, NULL);
+
+        seconds = end.tv_sec - start.tv_sec;
+        microseconds = end.tv_usec - start.tv_usec;
+        elapsed = seconds + microseconds * 1e-6;
+        total_e += elapsed;
+
         // Transposition performance evaluation
         gettimeofday(&start, NULL);
-        matTranspose(matrix, transpose, n);
+        matTranspose(&matrix, &transpose);
         gettimeofday(&end, NULL);
 
         // Making sure that the transposition happened correctly
-        int isTransposed = checkTranspose(matrix, transpose, n);
+        int isTransposed = checkTranspose(&matrix, &transpose);
         printf("%s", isTransposed ? "" : "The matrix is not transposed correctly\n");
 
         seconds = end.tv_sec - start.tv_sec;
@@ -121,11 +301,40 @@ int main(int argc, char *argv[]) {
     }
 
     printf("Average symmetry chck time (size: %d, iter: %d): %f\n", n, iterations, (total_s / iterations) * 1000);
+    printf("Average early-exit symmetry chck time (size: %d, iter: %d): %f\n", n, iterations, (total_e / iterations) * 1000);
     printf("Average transposition time (size: %d, iter: %d): %f\n", n, iterations, (total_t / iterations) * 1000);
 
-    // Free memory
-    for (int i = 0; i < n; i++) {
-        free(matrix[i]);
-        free(transpose[i]);
+    // In-place rectangular transposition performance, a copy of the input is kept (outside of the timing) for the check
+    if (rect_rows > 0) {
+        Matrix rect, original;
+        matrixAllocPacked(&rect, rect_rows, n);
+        matrixAllocPacked(&original, rect_rows, n);
+        double total_r = 0.0;
+
+        for (int iter = 0; iter < iterations; iter++) {
+            struct timeval start, end;
+
+            rect.rows = rect_rows;
+            rect.cols = rect.ld = n;
+            initializeMatrix(&rect);
+            memcpy(original.data, rect.data, (size_t)rect_rows * n * sizeof(float));
+
+            gettimeofday(&start, NULL);
+            matTransposeInPlaceRect(&rect);
+            gettimeofday(&end, NULL);
+
+            int isTransposed = checkTranspose(&original, &rect);
+            printf("%s", isTransposed ? "" : "The matrix is not transposed correctly in place\n");
+
+            total_r += (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) * 1e-6;
+        }
+
+        printf("Average in-place transposition time (size: %dx%d, iter: %d): %f\n", rect_rows, n, iterations, (total_r / iterations) * 1000);
+        matrixFree(&rect);
+        matrixFree(&original);
     }
+
+    // Free memory
+    matrixFree(&matrix);
+    matrixFree(&transpose);
 }
\ No newline at end of file
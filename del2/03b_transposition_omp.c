@@ -4,50 +4,140 @@
 #include <stdlib.h>
 #include <sys/time.h>
 
-#define FLOAT_COMPARE_TOLERANCE 1e-6
+#include "../common/affinity.h"
+#include "../common/cpu_dispatch.h"
+#include "../common/matrix.h"
+#include "../common/numa_alloc.h"
+#include "../common/worker_pool.h"
 
-void initializeMatrix(float **matrix, int n) {
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < n; j++) {
-            matrix[i][j] = (float)rand() / RAND_MAX * 10.0f;
+void initializeMatrix(Matrix *matrix) {
+    for (int i = 0; i < matrix->rows; i++) {
+        for (int j = 0; j < matrix->cols; j++) {
+            MAT_AT(matrix, i, j) = (float)rand() / RAND_MAX * 10.0f;
         }
     }
 }
 
-// Symmetry check without blocks
-int checkSymOMP(float **matrix, int n, int num_threads) {
+// Symmetry check without blocks: every strip of 16 rows, from the diagonal to the right, is compared to the mirror strip
+// of columns below the diagonal by the tile kernels (mirror tiles transposed in registers, SIMD compares), so only the
+// upper triangle is visited and every access is unit-stride
+// With fullScan (benchmark mode) it covers the entire upper triangle even when asymmetric. Otherwise the first mismatch
+// raises a shared flag that every thread polls before each strip, so all the threads stop within a strip
+int checkSymOMP(const Matrix *matrix, int num_threads, int fullScan) {
+    const KernelTable *k = kernels();
+    const FloatCompare cmp = symmetryCompare();
+    int n = matrix->rows;
     omp_set_num_threads(num_threads);
 
-    int sym = 1;
+    int strip = 16;
+    int mismatch = 0;
 
-#pragma omp parallel for default(none) shared(matrix, n) reduction(&& : sym)
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < n; j++) {
-            if (fabs(matrix[i][j] - matrix[j][i]) > FLOAT_COMPARE_TOLERANCE) {
-                sym = 0;
+#pragma omp parallel default(none) shared(matrix, k, cmp, n, strip, fullScan, mismatch)
+    {
+        affinityPinTeamMember();
+#pragma omp for schedule(dynamic)
+        for (int i = 0; i < n; i += strip) {
+            int stop;
+#pragma omp atomic read
+            stop = mismatch;
+            if (stop && !fullScan) continue;
+
+            // The kernels return at the first mismatch, so the full scan goes through the strip strip x strip at a time
+            int rows = i + strip > n ? n - i : strip;
+            int width = fullScan ? strip : n - i;
+            for (int j = i; j < n; j += width) {
+                int cols = j + width > n ? n - j : width;
+                if (!k->checkSymBlock(&MAT_AT(matrix, i, j), matrix->ld, &MAT_AT(matrix, j, i), matrix->ld, rows, cols, cmp)) {
+#pragma omp atomic write
+                    mismatch = 1;
+                }
             }
         }
     }
-    return sym;
+    return !mismatch;
 }
 
 // Transposition function without blocks
-int matTransposeOMP(float **matrix, float **transpose, int n, int num_threads) {
+int matTransposeOMP(const Matrix *matrix, Matrix *transpose, int num_threads) {
+    int n = matrix->rows;
     omp_set_num_threads(num_threads);
 
-#pragma omp parallel for default(none) shared(matrix, transpose, n)
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < n; j++) {
-            transpose[j][i] = matrix[i][j];
+#pragma omp parallel default(none) shared(matrix, transpose, n)
+    {
+        affinityPinTeamMember();
+#pragma omp for
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                MAT_AT(transpose, j, i) = MAT_AT(matrix, i, j);
+            }
         }
     }
     return 1;
 }
 
-int checkTranspose(float **matrix, float **transpose, int n) {
-    for (int i = 0; i < n; i++) {
+// Same symmetry check and transposition as jobs of the persistent worker pool: the threads are already running, so a
+// call costs a handoff of a few microseconds instead of a parallel region (relevant for the small sizes)
+typedef struct {
+    const Matrix *matrix;
+    Matrix *transpose;
+    int fullScan;
+    int next;
+    int mismatch;
+} PoolArgs;
+
+void checkSymJob(void *data, int worker, int n_workers) {
+    (void)worker;
+    (void)n_workers;
+    PoolArgs *args = (PoolArgs *)data;
+    const Matrix *matrix = args->matrix;
+    const KernelTable *k = kernels();
+    const FloatCompare cmp = symmetryCompare();
+    int n = matrix->rows;
+    int strip = 16;
+
+    for (int i; (i = poolNextChunk(&args->next, strip, n)) >= 0;) {
+        if (__atomic_load_n(&args->mismatch, __ATOMIC_RELAXED) && !args->fullScan) break;
+
+        int rows = i + strip > n ? n - i : strip;
+        int width = args->fullScan ? strip : n - i;
+        for (int j = i; j < n; j += width) {
+            int cols = j + width > n ? n - j : width;
+            if (!k->checkSymBlock(&MAT_AT(matrix, i, j), matrix->ld, &MAT_AT(matrix, j, i), matrix->ld, rows, cols, cmp)) {
+                __atomic_store_n(&args->mismatch, 1, __ATOMIC_RELAXED);
+            }
+        }
+    }
+}
+
+int checkSymPool(const Matrix *matrix, WorkerPool *pool, int fullScan) {
+    PoolArgs args = {matrix, NULL, fullScan, 0, 0};
+    poolRun(pool, checkSymJob, &args);
+    return !args.mismatch;
+}
+
+// Rows are split in contiguous ranges, like the static schedule of matTransposeOMP
+void matTransposeJob(void *data, int worker, int n_workers) {
+    PoolArgs *args = (PoolArgs *)data;
+    int n = args->matrix->rows;
+    int begin = (int)((long)n * worker / n_workers), end = (int)((long)n * (worker + 1) / n_workers);
+
+    for (int i = begin; i < end; i++) {
         for (int j = 0; j < n; j++) {
-            if (matrix[i][j] != transpose[j][i]) {
+            MAT_AT(args->transpose, j, i) = MAT_AT(args->matrix, i, j);
+        }
+    }
+}
+
+int matTransposePool(const Matrix *matrix, Matrix *transpose, WorkerPool *pool) {
+    PoolArgs args = {matrix, transpose, 0, 0, 0};
+    poolRun(pool, matTransposeJob, &args);
+    return 1;
+}
+
+int checkTranspose(const Matrix *matrix, const Matrix *transpose) {
+    for (int i = 0; i < matrix->rows; i++) {
+        for (int j = 0; j < matrix->cols; j++) {
+            if (MAT_AT(matrix, i, j) != MAT_AT(transpose, j, i)) {
                 return 0;
             }
         }
@@ -56,15 +146,15 @@ int checkTranspose(float **matrix, float **transpose, int n) {
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 4) {
-        printf("Usage: %s <n> <n_threads> <iterations>\n", argv[0]);
+    if (argc != 4 && argc != 5) {
+        printf("Usage: %s <n> <n_threads> <iterations> [serial|firsttouch|interleave]\n", argv[0]);
         return 1;
     }
 
     int e = atoi(argv[1]);
     int num_threads = atoi(argv[2]);
     int iterations = atoi(argv[3]);
-    double total_t, total_s = 0.0;
+    double total_t = 0.0, total_s = 0.0, total_e = 0.0, total_ps = 0.0, total_pt = 0.0;
     if (iterations < 1 || iterations > 50) {
         printf("Number of iterations must be 1 <= iterations <= 50\n");
         return 1;
@@ -77,14 +167,33 @@ int main(int argc, char *argv[]) {
         printf("Number of threads must be greater than 0\n");
         return 1;
     }
+    affinityApply(num_threads);
 
     // Allocate memory for the matrix and its transpose
     int n = 1 << e;
-    float **matrix = (float **)malloc(n * sizeof(float *));
-    float **transpose = (float **)malloc(n * sizeof(float *));
-    for (int i = 0; i < n; i++) {
-        matrix[i] = (float *)malloc(n * sizeof(float));
-        transpose[i] = (float *)malloc(n * sizeof(float));
+    NumaPolicy numa = argc == 5 ? numaPolicyFromString(argv[4]) : NUMA_SERIAL;
+    Matrix matrix, transpose;
+    matrixAllocNuma(&matrix, n, n, numa);
+    matrixAllocNuma(&transpose, n, n, numa);
+
+    // Pages are first touched with the same row to thread mapping as the kernels (blocks of a single row/element)
+    int touch_block = 1;
+    if (numa != NUMA_SERIAL) {
+        omp_set_num_threads(num_threads);
+        matrixFirstTouch(&matrix, touch_block, 0, 1);
+        matrixFirstTouch(&transpose, touch_block, 1, 0);
+        numaReport("Matrix", &matrix);
+        numaReport("Transpose", &transpose);
+    }
+
+    // The pooled times are only comparable with the OpenMP ones if the pool has all the threads
+    WorkerPool pool;
+    if (!poolCreate(&pool, num_threads)) {
+        printf("Could only start %d of the %d pool workers\n", pool.n_workers, num_threads);
+        poolDestroy(&pool);
+        matrixFreeNuma(&matrix, numa);
+        matrixFreeNuma(&transpose, numa);
+        return 1;
     }
 
     // Transposition and symmetry check performance
@@ -93,11 +202,19 @@ int main(int argc, char *argv[]) {
         long seconds, microseconds;
         double elapsed;
 
-        initializeMatrix(matrix, n);
+        if (numa == NUMA_SERIAL) {
+            initializeMatrix(&matrix);
+        } else {
+            matrixFirstTouch(&matrix, touch_block, 0, 1);
+        }
+
+        // Untimed region that starts the OpenMP team again after it was released for the pooled timings
+#pragma omp parallel num_threads(num_threads)
+        affinityPinTeamMember();
 
         // Symmetry check performance evaluation
         gettimeofday(&start, NULL);
-        int isSym = checkSymOMP(matrix, n, num_threads);
+        int isSym = checkSymOMP(&matrix, num_threads, 1);
         gettimeofday(&end, NULL);
 
         seconds = end.tv_sec - start.tv_sec;
@@ -105,27 +222,64 @@ int main(int argc, char *argv[]) {
         elapsed = seconds + microseconds * 1e-6;
         total_s += elapsed;
 
+        // Early-exit symmetry check (stops at the first mismatch)
+        gettimeofday(&start, NULL);
+        if (checkSymOMP(&matrix, num_threads, 0) != isSym) printf("The early-exit symmetry check disagrees with the full scan\n");
+        gettimeofday(&end, NULL);
+
+        seconds = end.tv_sec - start.tv_sec;
+        microseconds = end.tv_usec - start.tv_usec;
+        elapsed = seconds + microseconds * 1e-6;
+        total_e += elapsed;
+
         // Transposition performance evaluation
         gettimeofday(&start, NULL);
-        matTransposeOMP(matrix, transpose, n, num_threads);
+        matTransposeOMP(&matrix, &transpose, num_threads);
         gettimeofday(&end, NULL);
 
         // Making sure that the transposition happened correctly
-        int isTransposed = checkTranspose(matrix, transpose, n);
+        int isTransposed = checkTranspose(&matrix, &transpose);
         printf("%s", isTransposed ? "" : "The matrix is not transposed correctly\n");
 
         seconds = end.tv_sec - start.tv_sec;
         microseconds = end.tv_usec - start.tv_usec;
         elapsed = seconds + microseconds * 1e-6;
         total_t += elapsed;
+
+        // Same symmetry check and transposition submitted to the worker pool. The idle OpenMP threads keep spinning
+        // for a while on the CPUs the pool workers are pinned to, so they are released first
+        omp_pause_resource_all(omp_pause_soft);
+        gettimeofday(&start, NULL);
+        if (checkSymPool(&matrix, &pool, 1) != isSym) printf("The pooled symmetry check disagrees with the OpenMP one\n");
+        gettimeofday(&end, NULL);
+
+        seconds = end.tv_sec - start.tv_sec;
+        microseconds = end.tv_usec - start.tv_usec;
+        elapsed = seconds + microseconds * 1e-6;
+        total_ps += elapsed;
+
+        matrixZero(&transpose);
+        gettimeofday(&start, NULL);
+        matTransposePool(&matrix, &transpose, &pool);
+        gettimeofday(&end, NULL);
+
+        isTransposed = checkTranspose(&matrix, &transpose);
+        printf("%s", isTransposed ? "" : "The matrix is not transposed correctly (pool)\n");
+
+        seconds = end.tv_sec - start.tv_sec;
+        microseconds = end.tv_usec - start.tv_usec;
+        elapsed = seconds + microseconds * 1e-6;
+        total_pt += elapsed;
     }
+    poolDestroy(&pool);
 
     printf("Average symmetry chck time (size: %d, iter: %d): %f\n", n, iterations, (total_s / iterations) * 1000);
+    printf("Average early-exit symmetry chck time (size: %d, iter: %d): %f\n", n, iterations, (total_e / iterations) * 1000);
     printf("Average transposition time (size: %d, iter: %d): %f\n", n, iterations, (total_t / iterations) * 1000);
+    printf("Average pooled symmetry chck time (size: %d, iter: %d): %f\n", n, iterations, (total_ps / iterations) * 1000);
+    printf("Average pooled transposition time (size: %d, iter: %d): %f\n", n, iterations, (total_pt / iterations) * 1000);
 
     // Free memory
-    for (int i = 0; i < n; i++) {
-        free(matrix[i]);
-        free(transpose[i]);
-    }
+    matrixFreeNuma(&matrix, numa);
+    matrixFreeNuma(&transpose, numa);
 }
\ No newline at end of file
@@ -4,51 +4,74 @@
 #include <stdlib.h>
 #include <sys/time.h>
 
-#define FLOAT_COMPARE_TOLERANCE 1e-6
+#include "../common/affinity.h"
+#include "../common/matrix.h"
+#include "../common/numa_alloc.h"
+#include "../common/transpose_recursive.h"
+#include "../common/transpose_types.h"
 
-void initializeMatrix(float **matrix, int n) {
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < n; j++) {
-            matrix[i][j] = (float)rand() / RAND_MAX * 10.0f;
+void initializeMatrix(Matrix *matrix) {
+    for (int i = 0; i < matrix->rows; i++) {
+        for (int j = 0; j < matrix->cols; j++) {
+            MAT_AT(matrix, i, j) = (float)rand() / RAND_MAX * 10.0f;
         }
     }
 }
 
-// Symmetry check by blocks of 16 for consistent comparison
-// Even when asymmetric (most of the time), it will still cover the entire matrix
-int checkSymOMP(float **matrix, int n, int num_threads) {
+// Symmetry check by blocks of 16 for consistent comparison: only the block pairs (I, J) with I <= J are visited,
+// the mirror block is transposed in registers and compared to the block with SIMD compares (every access is unit-stride)
+// With fullScan (benchmark mode) it covers the entire upper triangle even when asymmetric (most of the time). Otherwise the
+// first mismatch raises a shared flag that every thread polls before each block, so all the threads stop within a block
+int checkSymOMP(const Matrix *matrix, int num_threads, int fullScan) {
+    const KernelTable *k = kernels();
+    const FloatCompare cmp = symmetryCompare();
+    int n = matrix->rows;
     omp_set_num_threads(num_threads);
 
     int block_size = 16;
-    int sym = 1;
-
-#pragma omp parallel for default(none) shared(matrix, n, block_size) reduction(&& : sym)
-    for (int i = 0; i < n; i += block_size) {
-        for (int j = 0; j < n; j += block_size) {
-            for (int ii = i; ii < i + block_size && ii < n; ii++) {
-                for (int jj = j; jj < j + block_size && jj < n; jj++) {
-                    if (fabs(matrix[ii][jj] - matrix[jj][ii]) > FLOAT_COMPARE_TOLERANCE) {
-                        sym = 0;
-                    }
+    int mismatch = 0;
+
+    // Block rows get shorter going down the triangle, so they are handed out dynamically
+#pragma omp parallel default(none) shared(matrix, k, cmp, n, block_size, fullScan, mismatch)
+    {
+        affinityPinTeamMember();
+#pragma omp for schedule(dynamic)
+        for (int i = 0; i < n; i += block_size) {
+            int rows = i + block_size > n ? n - i : block_size;
+            for (int j = i; j < n; j += block_size) {
+                int stop;
+#pragma omp atomic read
+                stop = mismatch;
+                if (stop && !fullScan) break;
+
+                int cols = j + block_size > n ? n - j : block_size;
+                if (!k->checkSymBlock(&MAT_AT(matrix, i, j), matrix->ld, &MAT_AT(matrix, j, i), matrix->ld, rows, cols, cmp)) {
+#pragma omp atomic write
+                    mismatch = 1;
                 }
             }
         }
     }
-    return sym;
+    return !mismatch;
 }
 
 // Transposition function by blocks of 16 for consistent comparison
-int matTransposeOMP(float **matrix, float **transpose, int n, int num_threads) {
+int matTransposeOMP(const Matrix *matrix, Matrix *transpose, int num_threads) {
+    int n = matrix->rows;
     omp_set_num_threads(num_threads);
 
     int block_size = 16;
 
-#pragma omp parallel for default(none) shared(matrix, transpose, n, block_size)
-    for (int i = 0; i < n; i += block_size) {
-        for (int j = 0; j < n; j += block_size) {
-            for (int ii = i; ii < i + block_size && ii < n; ii++) {
-                for (int jj = j; jj < j + block_size && jj < n; jj++) {
-                    transpose[jj][ii] = matrix[ii][jj];
+#pragma omp parallel default(none) shared(matrix, transpose, n, block_size)
+    {
+        affinityPinTeamMember();
+#pragma omp for
+        for (int i = 0; i < n; i += block_size) {
+            for (int j = 0; j < n; j += block_size) {
+                for (int ii = i; ii < i + block_size && ii < n; ii++) {
+                    for (int jj = j; jj < j + block_size && jj < n; jj++) {
+                        MAT_AT(transpose, jj, ii) = MAT_AT(matrix, ii, jj);
+                    }
                 }
             }
         }
@@ -56,10 +79,115 @@ int matTransposeOMP(float **matrix, float **transpose, int n, int num_threads) {
     return 1;
 }
 
-int checkTranspose(float **matrix, float **transpose, int n) {
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < n; j++) {
-            if (matrix[i][j] != transpose[j][i]) {
+// Cache-oblivious transposition: recursive splits instead of a fixed block size, OpenMP tasks above the cutoff
+int matTransposeRecursiveOMP(const Matrix *matrix, Matrix *transpose, int num_threads) {
+    omp_set_num_threads(num_threads);
+
+    const KernelTable *k = kernels();
+
+#pragma omp parallel default(none) shared(matrix, transpose, k)
+    {
+        affinityPinTeamMember();
+#pragma omp single
+        transposeRecursive(k, matrix->data, matrix->ld, transpose->data, transpose->ld, matrix->rows, matrix->cols);
+    }
+    return 1;
+}
+
+// The same blocks of 16 for the other element types, each one checked/transposed by the tile kernels of its width.
+// Like checkSymOMP, only the block pairs (I, J) with I <= J are visited, and without fullScan the first mismatch stops all the threads
+int checkSymTypedOMP(const TypedMatrix *matrix, int num_threads, int fullScan) {
+    const TypedKernelTable *t = typedKernels(matrix->dtype);
+    const FloatCompare cmp = symmetryCompare();
+    int n = matrix->rows;
+    omp_set_num_threads(num_threads);
+
+    int block_size = 16;
+    int mismatch = 0;
+
+#pragma omp parallel default(none) shared(matrix, t, cmp, n, block_size, fullScan, mismatch)
+    {
+        affinityPinTeamMember();
+#pragma omp for schedule(dynamic)
+        for (int i = 0; i < n; i += block_size) {
+            int rows = i + block_size > n ? n - i : block_size;
+            for (int j = i; j < n; j += block_size) {
+                int stop;
+#pragma omp atomic read
+                stop = mismatch;
+                if (stop && !fullScan) break;
+
+                int cols = j + block_size > n ? n - j : block_size;
+                if (!checkSymBlockTyped(t, typedAt(matrix, i, j), matrix->ld, typedAt(matrix, j, i), matrix->ld, rows, cols, cmp)) {
+#pragma omp atomic write
+                    mismatch = 1;
+                }
+            }
+        }
+    }
+    return !mismatch;
+}
+
+int matTransposeTypedOMP(const TypedMatrix *matrix, TypedMatrix *transpose, int num_threads) {
+    const TypedKernelTable *t = typedKernels(matrix->dtype);
+    int n = matrix->rows;
+    omp_set_num_threads(num_threads);
+
+    int block_size = 16;
+
+#pragma omp parallel default(none) shared(matrix, transpose, t, n, block_size)
+    {
+        affinityPinTeamMember();
+#pragma omp for
+        for (int i = 0; i < n; i += block_size) {
+            for (int j = 0; j < n; j += block_size) {
+                int rows = i + block_size > n ? n - i : block_size;
+                int cols = j + block_size > n ? n - j : block_size;
+                t->transposeBlock(typedAt(matrix, i, j), matrix->ld, typedAt(transpose, j, i), transpose->ld, rows, cols);
+            }
+        }
+    }
+    return 1;
+}
+
+// Symmetry check and transposition timings for an element type other than float
+void benchmarkTyped(int n, int num_threads, int iterations, DType dtype) {
+    double total_t = 0.0, total_s = 0.0, total_e = 0.0;
+    TypedMatrix matrix, transpose;
+    typedMatrixAlloc(&matrix, n, n, dtype);
+    typedMatrixAlloc(&transpose, n, n, dtype);
+
+    for (int iter = 0; iter < iterations; iter++) {
+        typedMatrixRandom(&matrix);
+
+        double start = omp_get_wtime();
+        int isSym = checkSymTypedOMP(&matrix, num_threads, 1);
+        total_s += omp_get_wtime() - start;
+
+        start = omp_get_wtime();
+        if (checkSymTypedOMP(&matrix, num_threads, 0) != isSym) printf("The early-exit symmetry check disagrees with the full scan\n");
+        total_e += omp_get_wtime() - start;
+
+        start = omp_get_wtime();
+        matTransposeTypedOMP(&matrix, &transpose, num_threads);
+        total_t += omp_get_wtime() - start;
+
+        printf("%s", typedCheckTranspose(&matrix, &transpose) ? "" : "The matrix is not transposed correctly\n");
+    }
+
+    printf("Average symmetry chck time (size: %d, iter: %d, type: %s): %f\n", n, iterations, dtypeInfo[dtype].name, (total_s / iterations) * 1000);
+    printf("Average early-exit symmetry chck time (size: %d, iter: %d, type: %s): %f\n", n, iterations, dtypeInfo[dtype].name,
+           (total_e / iterations) * 1000);
+    printf("Average transposition time (size: %d, iter: %d, type: %s): %f\n", n, iterations, dtypeInfo[dtype].name, (total_t / iterations) * 1000);
+
+    typedMatrixFree(&matrix);
+    typedMatrixFree(&transpose);
+}
+
+int checkTranspose(const Matrix *matrix, const Matrix *transpose) {
+    for (int i = 0; i < matrix->rows; i++) {
+        for (int j = 0; j < matrix->cols; j++) {
+            if (MAT_AT(matrix, i, j) != MAT_AT(transpose, j, i)) {
                 return 0;
             }
         }
@@ -68,15 +196,15 @@ int checkTranspose(float **matrix, float **transpose, int n) {
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 4) {
-        printf("Usage: %s <n> <n_threads> <iterations>\n", argv[0]);
+    if (argc < 4 || argc > 6) {
+        printf("Usage: %s <n> <n_threads> <iterations> [serial|firsttouch|interleave] [dtype]\n", argv[0]);
         return 1;
     }
 
     int e = atoi(argv[1]);
     int num_threads = atoi(argv[2]);
     int iterations = atoi(argv[3]);
-    double total_t, total_s = 0.0;
+    double total_t = 0.0, total_s = 0.0, total_e = 0.0, total_r = 0.0;
     if (iterations < 1 || iterations > 50) {
         printf("Number of iterations must be 1 <= iterations <= 50\n");
         return 1;
@@ -89,14 +217,33 @@ int main(int argc, char *argv[]) {
         printf("Number of threads must be greater than 0\n");
         return 1;
     }
+    affinityApply(num_threads);
+
+    int dtype = argc == 6 ? dtypeFromString(argv[5]) : DTYPE_FLOAT;
+    if (dtype < 0) {
+        printf("Element type must be one of float, double, int8, uint8, int16, int32, complex64, complex128\n");
+        return 1;
+    }
 
     // Allocate memory for the matrix and its transpose
     int n = 1 << e;
-    float **matrix = (float **)malloc(n * sizeof(float *));
-    float **transpose = (float **)malloc(n * sizeof(float *));
-    for (int i = 0; i < n; i++) {
-        matrix[i] = (float *)malloc(n * sizeof(float));
-        transpose[i] = (float *)malloc(n * sizeof(float));
+    if (dtype != DTYPE_FLOAT) {
+        benchmarkTyped(n, num_threads, iterations, (DType)dtype);
+        return 0;
+    }
+    NumaPolicy numa = argc >= 5 ? numaPolicyFromString(argv[4]) : NUMA_SERIAL;
+    Matrix matrix, transpose;
+    matrixAllocNuma(&matrix, n, n, numa);
+    matrixAllocNuma(&transpose, n, n, numa);
+
+    // Pages are first touched with the same block to thread mapping as the kernels (blocks of 16)
+    int touch_block = 16;
+    if (numa != NUMA_SERIAL) {
+        omp_set_num_threads(num_threads);
+        matrixFirstTouch(&matrix, touch_block, 0, 1);
+        matrixFirstTouch(&transpose, touch_block, 1, 0);
+        numaReport("Matrix", &matrix);
+        numaReport("Transpose", &transpose);
     }
 
     // Transposition and symmetry check performance
@@ -105,11 +252,15 @@ int main(int argc, char *argv[]) {
         long seconds, microseconds;
         double elapsed;
 
-        initializeMatrix(matrix, n);
+        if (numa == NUMA_SERIAL) {
+            initializeMatrix(&matrix);
+        } else {
+            matrixFirstTouch(&matrix, touch_block, 0, 1);
+        }
 
         // Symmetry check performance evaluation
         gettimeofday(&start, NULL);
-        int isSym = checkSymOMP(matrix, n, num_threads);
+        int isSym = checkSymOMP(&matrix, num_threads, 1);
         gettimeofday(&end, NULL);
 
         seconds = end.tv_sec - start.tv_sec;
@@ -117,27 +268,51 @@ int main(int argc, char *argv[]) {
         elapsed = seconds + microseconds * 1e-6;
         total_s += elapsed;
 
+        // Early-exit symmetry check (stops at the first mismatch)
+        gettimeofday(&start, NULL);
+        if (checkSymOMP(&matrix, num_threads, 0) != isSym) printf("The early-exit symmetry check disagrees with the full scan\n");
+        gettimeofday(&end, NULL);
+
+        seconds = end.tv_sec - start.tv_sec;
+        microseconds = end.tv_usec - start.tv_usec;
+        elapsed = seconds + microseconds * 1e-6;
+        total_e += elapsed;
+
         // Transposition performance evaluation
         gettimeofday(&start, NULL);
-        matTransposeOMP(matrix, transpose, n, num_threads);
+        matTransposeOMP(&matrix, &transpose, num_threads);
         gettimeofday(&end, NULL);
 
         // Making sure that the transposition happened correctly
-        int isTransposed = checkTranspose(matrix, transpose, n);
+        int isTransposed = checkTranspose(&matrix, &transpose);
         printf("%s", isTransposed ? "" : "The matrix is not transposed correctly\n");
 
         seconds = end.tv_sec - start.tv_sec;
         microseconds = end.tv_usec - start.tv_usec;
         elapsed = seconds + microseconds * 1e-6;
         total_t += elapsed;
+
+        // Cache-oblivious transposition performance evaluation
+        matrixZero(&transpose);
+        gettimeofday(&start, NULL);
+        matTransposeRecursiveOMP(&matrix, &transpose, num_threads);
+        gettimeofday(&end, NULL);
+
+        isTransposed = checkTranspose(&matrix, &transpose);
+        printf("%s", isTransposed ? "" : "The matrix is not transposed correctly (recursive)\n");
+
+        seconds = end.tv_sec - start.tv_sec;
+        microseconds = end.tv_usec - start.tv_usec;
+        elapsed = seconds + microseconds * 1e-6;
+        total_r += elapsed;
     }
 
     printf("Average symmetry chck time (size: %d, iter: %d): %f\n", n, iterations, (total_s / iterations) * 1000);
+    printf("Average early-exit symmetry chck time (size: %d, iter: %d): %f\n", n, iterations, (total_e / iterations) * 1000);
     printf("Average transposition time (size: %d, iter: %d): %f\n", n, iterations, (total_t / iterations) * 1000);
+    printf("Average recursive transposition time (size: %d, iter: %d): %f\n", n, iterations, (total_r / iterations) * 1000);
 
     // Free memory
-    for (int i = 0; i < n; i++) {
-        free(matrix[i]);
-        free(transpose[i]);
-    }
+    matrixFreeNuma(&matrix, numa);
+    matrixFreeNuma(&transpose, numa);
 }
\ No newline at end of file
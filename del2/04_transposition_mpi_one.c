@@ -1,51 +1,41 @@
-#include <math.h>
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
 #include <time.h>
 
-#define EPSILON 1e-6
-
-void initializeMatrix(float *matrix, int n) {
-    for (int i = 0; i < n * n; i++) {
-        matrix[i] = ((float)rand() / RAND_MAX) * 10.0f;
-    }
-}
-
-int checkTranspose(float *matrix, float *transposed, int n) {
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < n; j++) {
-            if (fabs(matrix[i * n + j] - transposed[j * n + i]) > EPSILON) {
-                return 0;
-            }
-        }
-    }
-    return 1;
-}
+#include "../common/distributed.h"
 
 // Symmetry check using MPI Broadcast to distribute the entire matrix to all processors
-int checkSymMPI(float *matrix, int n, int rank, int num_processor) {
+int checkSymMPI(void *matrix, int n, DType dtype, int rank, int num_processor, int n_threads) {
+    const TypedKernelTable *t = typedKernels(dtype);
+    const FloatCompare cmp = symmetryCompare();
+    size_t size = (size_t)t->size;
+
     // Allocate the entire matrix on all processes except rank 0
     if (rank != 0) {
-        matrix = (float *)malloc(n * n * sizeof(float));
+        matrix = malloc((size_t)n * n * size);
     }
-    // Every processor will handle n/num_processors rows
+    char *m = (char *)matrix;
+    // Every processor will handle n/num_processors rows (the last one also the remainder)
     int local_rows_number = n / num_processor;
-    int local_start_row = rank * (local_rows_number + 1);
-    int local_end_row = local_start_row + local_rows_number + 1;
+    int local_start_row = rank * local_rows_number;
+    int local_end_row = rank == num_processor - 1 ? n : local_start_row + local_rows_number;
 
     int local_sym = 1;
     int global_sym = 1;
 
     // Broadcast the entire matrix to all processes
-    MPI_Bcast(matrix, n * n, MPI_FLOAT, 0, MPI_COMM_WORLD);
-    // Check the symmetry of the local block of rows
+    MPI_Bcast(matrix, n * n, dtypeMPI(dtype), 0, MPI_COMM_WORLD);
+    // Check the symmetry of the local block of rows: row i right of the diagonal against column i below it
+    // (rows get shorter going down, so they are handed out dynamically to the threads of the rank)
+#pragma omp parallel for schedule(dynamic, 16) num_threads(n_threads) reduction(&& : local_sym)
     for (int i = local_start_row; i < local_end_row; i++) {
-        for (int j = i + 1; j < n; j++) {
-            if (fabs(matrix[i * n + j] - matrix[j * n + i]) > EPSILON) {
-                local_sym = 0;
-            }
+        const char *row = m + ((size_t)i * n + i + 1) * size;
+        const char *col = m + ((size_t)(i + 1) * n + i) * size;
+        if (!checkSymBlockTyped(t, row, n, col, n, 1, n - i - 1, cmp)) {
+            local_sym = 0;
         }
     }
     // Reduce the local symmetry checks to a global symmetry check
@@ -58,45 +48,188 @@ int checkSymMPI(float *matrix, int n, int rank, int num_processor) {
 }
 
 // Transposition using MPI Broadcast to distribute the entire matrix to all processors
-void matTransposeMPI(float *matrix, float *transposed, int n, int rank, int num_processors) {
+void matTransposeMPI(void *matrix, void *transposed, int n, DType dtype, int rank, int num_processors, int n_threads) {
+    const TypedKernelTable *t = typedKernels(dtype);
+    size_t size = (size_t)t->size;
+
     // Allocate the entire matrix on all processes except rank 0
     if (rank != 0) {
-        matrix = (float *)malloc(n * n * sizeof(float));
+        matrix = malloc((size_t)n * n * size);
     }
-    // Every processor will handle n/num_processors rows
-    int local_rows_number = n / num_processors;
-    int local_start_row = rank * local_rows_number;
-    int local_end_row = local_start_row + local_rows_number;
+    // Every processor will handle a block of n/num_processors rows (sizes differ by at most one)
+    int local_start_row = blockStart(n, num_processors, rank);
+    int local_rows_number = blockStart(n, num_processors, rank + 1) - local_start_row;
 
-    float *local_transposed = (float *)malloc(local_rows_number * n * sizeof(float));
+    void *local_transposed = malloc((size_t)local_rows_number * n * size);
+    int *counts = (int *)malloc(2 * num_processors * sizeof(int));
+    int *displs = counts + num_processors;
+    for (int k = 0; k < num_processors; k++) {
+        displs[k] = blockStart(n, num_processors, k) * n;
+        counts[k] = blockStart(n, num_processors, k + 1) * n - displs[k];
+    }
 
     // Broadcast the entire matrix to all processes
-    MPI_Bcast(matrix, n * n, MPI_FLOAT, 0, MPI_COMM_WORLD);
-    // Transpose the local block of rows
-    for (int i = local_start_row; i < local_end_row; i++) {
-        for (int j = 0; j < n; j++) {
-            local_transposed[(i - local_start_row) * n + j] = matrix[j * n + i];
-        }
-    }
+    MPI_Bcast(matrix, n * n, dtypeMPI(dtype), 0, MPI_COMM_WORLD);
+    // The local rows of the transpose are the columns local_start_row.. of the matrix, transposed by tiles (by the threads of the rank)
+    transposeBlockTypedOMP(t, (char *)matrix + (size_t)local_start_row * size, n, local_transposed, n, n, local_rows_number, n_threads);
     // Gather the transposed blocks from all processes
-    MPI_Gather(local_transposed, local_rows_number * n, MPI_FLOAT, transposed, local_rows_number * n, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    MPI_Gatherv(local_transposed, local_rows_number * n, dtypeMPI(dtype), transposed, counts, displs, dtypeMPI(dtype), 0, MPI_COMM_WORLD);
 
+    free(counts);
     free(local_transposed);
     if (rank != 0) {
         free(matrix);  // Free the allocated matrix on all processes except rank 0
     }
 }
 
+// Shared memory mode: the ranks of a node (MPI_Comm_split_type) map one copy of the matrix and one of the transpose,
+// allocated by the node leader (its lowest rank) with MPI_Win_allocate_shared, instead of one copy per rank. Only the
+// leaders (rank 0 is the leader of the first node) communicate across nodes; the other ranks read and write the
+// shared buffers directly, synchronized with MPI_Win_sync and a node barrier
+typedef struct {
+    MPI_Comm node;     // ranks of this node
+    MPI_Comm leaders;  // node leaders (MPI_COMM_NULL on the other ranks)
+    int node_rank, node_size;
+    int node_index, num_nodes; // index of this node among the leaders
+    MPI_Win input_win, output_win;
+    char *input, *output; // n x n each, shared by the node
+} SharedNode;
+
+static char *sharedAllocate(SharedNode *s, MPI_Aint bytes, int size, MPI_Win *win) {
+    char *base;
+    MPI_Aint segment;
+    int unit;
+    MPI_Win_allocate_shared(s->node_rank == 0 ? bytes : 0, size, MPI_INFO_NULL, s->node, &base, win);
+    MPI_Win_shared_query(*win, 0, &segment, &unit, &base);
+    // One passive epoch for the whole run: the windows are only accessed with loads and stores
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, *win);
+    return base;
+}
+
+int sharedInit(SharedNode *s, int n, DType dtype, int rank) {
+    int size = dtypeInfo[dtype].size;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &s->node);
+    MPI_Comm_rank(s->node, &s->node_rank);
+    MPI_Comm_size(s->node, &s->node_size);
+    MPI_Comm_split(MPI_COMM_WORLD, s->node_rank == 0 ? 0 : MPI_UNDEFINED, rank, &s->leaders);
+    if (s->node_rank == 0) {
+        MPI_Comm_rank(s->leaders, &s->node_index);
+        MPI_Comm_size(s->leaders, &s->num_nodes);
+    }
+    MPI_Bcast(&s->node_index, 1, MPI_INT, 0, s->node);
+    MPI_Bcast(&s->num_nodes, 1, MPI_INT, 0, s->node);
+
+    s->input = sharedAllocate(s, (MPI_Aint)n * n * size, size, &s->input_win);
+    s->output = sharedAllocate(s, (MPI_Aint)n * n * size, size, &s->output_win);
+    return s->input != NULL && s->output != NULL;
+}
+
+void sharedFree(SharedNode *s) {
+    MPI_Win_unlock_all(s->input_win);
+    MPI_Win_unlock_all(s->output_win);
+    MPI_Win_free(&s->input_win);
+    MPI_Win_free(&s->output_win);
+    if (s->leaders != MPI_COMM_NULL) MPI_Comm_free(&s->leaders);
+    MPI_Comm_free(&s->node);
+}
+
+// Makes the stores of the node to win visible to all its ranks
+static void sharedSync(SharedNode *s, MPI_Win win) {
+    MPI_Win_sync(win);
+    MPI_Barrier(s->node);
+    MPI_Win_sync(win);
+}
+
+// Symmetry check on the shared copy: the leaders broadcast the matrix (already in the input of rank 0) to the other
+// nodes, then every rank checks its rows as in checkSymMPI and the results are combined node by node
+int checkSymShared(SharedNode *s, int n, DType dtype, int rank, int num_processors, int n_threads) {
+    const TypedKernelTable *t = typedKernels(dtype);
+    const FloatCompare cmp = symmetryCompare();
+    size_t size = (size_t)t->size;
+
+    if (s->leaders != MPI_COMM_NULL) MPI_Bcast(s->input, n * n, dtypeMPI(dtype), 0, s->leaders);
+    sharedSync(s, s->input_win);
+
+    int local_rows_number = n / num_processors;
+    int local_start_row = rank * local_rows_number;
+    int local_end_row = rank == num_processors - 1 ? n : local_start_row + local_rows_number;
+    int local_sym = 1, node_sym = 1, global_sym = 1;
+#pragma omp parallel for schedule(dynamic, 16) num_threads(n_threads) reduction(&& : local_sym)
+    for (int i = local_start_row; i < local_end_row; i++) {
+        const char *row = s->input + ((size_t)i * n + i + 1) * size;
+        const char *col = s->input + ((size_t)(i + 1) * n + i) * size;
+        if (!checkSymBlockTyped(t, row, n, col, n, 1, n - i - 1, cmp)) {
+            local_sym = 0;
+        }
+    }
+
+    MPI_Reduce(&local_sym, &node_sym, 1, MPI_INT, MPI_LAND, 0, s->node);
+    if (s->leaders != MPI_COMM_NULL) MPI_Allreduce(&node_sym, &global_sym, 1, MPI_INT, MPI_LAND, s->leaders);
+    MPI_Bcast(&global_sym, 1, MPI_INT, 0, s->node);
+    return global_sym;
+}
+
+// Transposition on the shared copies: node k handles the rows [start_k, start_k+1) of the matrix, which the leaders
+// scatter from rank 0 into the input of every node, and its ranks split them further. Every rank writes its rows
+// transposed (columns of the transpose) straight into the shared output; the leaders then send the columns of their
+// node to rank 0, whose node output is the transpose
+void matTransposeShared(SharedNode *s, int n, DType dtype, int n_threads) {
+    const TypedKernelTable *t = typedKernels(dtype);
+    size_t size = (size_t)t->size;
+    MPI_Datatype type = dtypeMPI(dtype);
+    int node_start = blockStart(n, s->num_nodes, s->node_index);
+    int node_rows = blockStart(n, s->num_nodes, s->node_index + 1) - node_start;
+
+    if (s->leaders != MPI_COMM_NULL && s->num_nodes > 1) {
+        int *counts = (int *)malloc(2 * s->num_nodes * sizeof(int));
+        int *displs = counts + s->num_nodes;
+        for (int k = 0; k < s->num_nodes; k++) {
+            displs[k] = blockStart(n, s->num_nodes, k) * n;
+            counts[k] = blockStart(n, s->num_nodes, k + 1) * n - displs[k];
+        }
+        char *rows = s->input + (size_t)node_start * n * size;
+        MPI_Scatterv(s->input, counts, displs, type, s->node_index == 0 ? MPI_IN_PLACE : rows, node_rows * n, type, 0, s->leaders);
+        free(counts);
+    }
+    sharedSync(s, s->input_win);
+
+    int start = node_start + blockStart(node_rows, s->node_size, s->node_rank);
+    int rows = node_start + blockStart(node_rows, s->node_size, s->node_rank + 1) - start;
+    transposeBlockTypedOMP(t, s->input + (size_t)start * n * size, n, s->output + (size_t)start * size, n, rows, n, n_threads);
+    sharedSync(s, s->output_win);
+
+    // The columns of node k of the transpose: n rows of node_rows elements, n apart
+    if (s->leaders != MPI_COMM_NULL && s->num_nodes > 1) {
+        MPI_Datatype columns;
+        if (s->node_index == 0) {
+            for (int k = 1; k < s->num_nodes; k++) {
+                int k_start = blockStart(n, s->num_nodes, k);
+                MPI_Type_vector(n, blockStart(n, s->num_nodes, k + 1) - k_start, n, type, &columns);
+                MPI_Type_commit(&columns);
+                MPI_Recv(s->output + (size_t)k_start * size, 1, columns, k, 0, s->leaders, MPI_STATUS_IGNORE);
+                MPI_Type_free(&columns);
+            }
+        } else {
+            MPI_Type_vector(n, node_rows, n, type, &columns);
+            MPI_Type_commit(&columns);
+            MPI_Send(s->output + (size_t)node_start * size, 1, columns, 0, 0, s->leaders);
+            MPI_Type_free(&columns);
+        }
+    }
+}
+
 int main(int argc, char *argv[]) {
-    MPI_Init(&argc, &argv);
+    // Only the main thread of a rank calls MPI, the OpenMP threads work on local data in between
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
 
     int rank, num_processors;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &num_processors);
 
     // Input validation
-    if (rank == 0 && argc != 3) {
-        printf("Usage: mpirun -np <n_processors> %s <n> <iterations>\n", argv[0]);
+    if (rank == 0 && (argc < 3 || argc > 6)) {
+        printf("Usage: mpirun -np <n_processors> %s <n> <iterations> [dtype] [n_threads] [shared]\n", argv[0]);
         MPI_Abort(MPI_COMM_WORLD, 1);
     }
 
@@ -111,33 +244,67 @@ int main(int argc, char *argv[]) {
         if (rank == 0) printf("Number of iterations must be 1 <= iterations <= 50\n");
         MPI_Abort(MPI_COMM_WORLD, 1);
     }
+    int dtype = argc >= 4 ? dtypeFromString(argv[3]) : DTYPE_FLOAT;
+    int n_threads = argc >= 5 ? atoi(argv[4]) : 1;
+    // One copy of the matrix and of its transpose per node instead of per rank
+    int shared = argc == 6 && strcmp(argv[5], "shared") == 0;
+    if (dtype < 0) {
+        if (rank == 0) printf("Element type must be one of float, double, int8, uint8, int16, int32, complex64, complex128\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (n_threads < 1) {
+        if (rank == 0) printf("Number of threads must be greater than 0\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    // The OpenMP teams between the MPI calls need at least MPI_THREAD_FUNNELED, otherwise every rank runs serially
+    if (provided < MPI_THREAD_FUNNELED && n_threads > 1) {
+        if (rank == 0) printf("The MPI library does not provide MPI_THREAD_FUNNELED, using 1 thread per rank\n");
+        n_threads = 1;
+    }
     if (n < num_processors) {
         if (rank == 0) printf("Matrix n must be greater than or equal to the number of processors\n");
         MPI_Abort(MPI_COMM_WORLD, 1);
     }
 
-    // Instantiation of the matrix and its transpose
-    float *matrix = NULL;
-    float *transposed = NULL;
+    // Instantiation of the matrix and its transpose (only on rank 0)
+    // Rows are not padded (ld == n), so the buffers can be used as flat n * n arrays
+    TypedMatrix matrix = {0};
+    TypedMatrix transposed = {0};
 
-    if (rank == 0) {
-        matrix = (float *)malloc(n * n * sizeof(float));
-        transposed = (float *)malloc(n * n * sizeof(float));
+    SharedNode node;
+
+    if (shared) {
+        if (!sharedInit(&node, n, (DType)dtype, rank)) {
+            printf("Shared memory allocation failed on rank %d\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        // On rank 0 they are the shared buffers of its node
+        if (rank == 0) {
+            matrix = (TypedMatrix){node.input, n, n, n, (DType)dtype};
+            transposed = (TypedMatrix){node.output, n, n, n, (DType)dtype};
+        }
+    } else if (rank == 0) {
+        typedMatrixAllocPacked(&matrix, n, n, (DType)dtype);
+        typedMatrixAllocPacked(&transposed, n, n, (DType)dtype);
     }
 
     double start_time, end_time;
-    double total_s, total_t = 0.0;
+    double total_s = 0.0, total_t = 0.0;
     MPI_Barrier(MPI_COMM_WORLD);
 
     for (int iter = 0; iter < iterations; iter++) {
         if (rank == 0) {
-            initializeMatrix(matrix, n);
+            typedMatrixRandom(&matrix);
         }
 
         // Symmetry check performance evaluation
         MPI_Barrier(MPI_COMM_WORLD);
         start_time = MPI_Wtime();
-        checkSymMPI(matrix, n, rank, num_processors);
+        if (shared) {
+            checkSymShared(&node, n, (DType)dtype, rank, num_processors, n_threads);
+        } else {
+            checkSymMPI(matrix.data, n, (DType)dtype, rank, num_processors, n_threads);
+        }
         MPI_Barrier(MPI_COMM_WORLD);
         end_time = MPI_Wtime();
         if (rank == 0) total_s += (end_time - start_time);
@@ -145,23 +312,33 @@ int main(int argc, char *argv[]) {
         // Transposition performance evaluation
         MPI_Barrier(MPI_COMM_WORLD);
         start_time = MPI_Wtime();
-        matTransposeMPI(matrix, transposed, n, rank, num_processors);
+        if (shared) {
+            matTransposeShared(&node, n, (DType)dtype, n_threads);
+        } else {
+            matTransposeMPI(matrix.data, transposed.data, n, (DType)dtype, rank, num_processors, n_threads);
+        }
         MPI_Barrier(MPI_COMM_WORLD);
         end_time = MPI_Wtime();
 
         if (rank == 0) {
             total_t += (end_time - start_time);
-            int success = checkTranspose(matrix, transposed, n);
+            int success = typedCheckTranspose(&matrix, &transposed);
             printf("%s", success ? "" : "Matrix transposition failed\n");
         }
     }
 
     if (rank == 0) {
-        printf("Average symmetry chck time (size: %d, np: %d, iterations: %d): %f ms\n", n, num_processors, iterations, (total_s / iterations) * 1000);
-        printf("Average transposition time (size: %d, np: %d, iterations: %d): %f ms\n", n, num_processors, iterations, (total_t / iterations) * 1000);
-        free(matrix);
-        free(transposed);
+        const char *mode = shared ? "shared " : "";
+        printf("Average %ssymmetry chck time (size: %d, np: %d, threads: %d, iterations: %d, type: %s): %f ms\n", mode, n, num_processors, n_threads,
+               iterations, dtypeInfo[dtype].name, (total_s / iterations) * 1000);
+        printf("Average %stransposition time (size: %d, np: %d, threads: %d, iterations: %d, type: %s): %f ms\n", mode, n, num_processors, n_threads,
+               iterations, dtypeInfo[dtype].name, (total_t / iterations) * 1000);
+        if (!shared) {
+            typedMatrixFree(&matrix);
+            typedMatrixFree(&transposed);
+        }
     }
+    if (shared) sharedFree(&node);
 
     MPI_Finalize();
     return 0;
@@ -1,50 +1,40 @@
-#include <math.h>
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
 
-#define EPSILON 1e-6
-
-void initializeMatrix(float *matrix, int n) {
-    for (int i = 0; i < n * n; i++) {
-        matrix[i] = ((float)rand() / RAND_MAX) * 10.0f;
-    }
-}
-
-int checkTranspose(float *matrix, float *transposed, int n) {
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < n; j++) {
-            if (fabs(matrix[i * n + j] - transposed[j * n + i]) > EPSILON) {
-                return 0;
-            }
-        }
-    }
-    return 1;
-}
+#include "../common/distributed.h"
 
 // Symmetry check using MPI Broadcast to distribute the entire matrix to all processors
-int checkSymMPI(float *matrix, int n, int rank, int num_processor) {
+int checkSymMPI(void *matrix, int n, DType dtype, int rank, int num_processor, int n_threads) {
+    const TypedKernelTable *t = typedKernels(dtype);
+    const FloatCompare cmp = symmetryCompare();
+    size_t size = (size_t)t->size;
+
     // Allocate the entire matrix on all processes except rank 0
     if (rank != 0) {
-        matrix = (float *)malloc(n * n * sizeof(float));
+        matrix = malloc((size_t)n * n * size);
     }
-    // Every processor will handle n/num_processors rows
+    char *m = (char *)matrix;
+    // Every processor will handle n/num_processors rows (the last one also the remainder)
     int local_rows_number = n / num_processor;
-    int local_start_row = rank * (local_rows_number + 1);
-    int local_end_row = local_start_row + local_rows_number + 1;
+    int local_start_row = rank * local_rows_number;
+    int local_end_row = rank == num_processor - 1 ? n : local_start_row + local_rows_number;
 
     int local_sym = 1;
     int global_sym = 1;
 
     // Broadcast the entire matrix to all processes
-    MPI_Bcast(matrix, n * n, MPI_FLOAT, 0, MPI_COMM_WORLD);
-    // Check the symmetry of the local block of rows
+    MPI_Bcast(matrix, n * n, dtypeMPI(dtype), 0, MPI_COMM_WORLD);
+    // Check the symmetry of the local block of rows: row i right of the diagonal against column i below it
+    // (rows get shorter going down, so they are handed out dynamically to the threads of the rank)
+#pragma omp parallel for schedule(dynamic, 16) num_threads(n_threads) reduction(&& : local_sym)
     for (int i = local_start_row; i < local_end_row; i++) {
-        for (int j = i + 1; j < n; j++) {
-            if (fabs(matrix[i * n + j] - matrix[j * n + i]) > EPSILON) {
-                local_sym = 0;
-            }
+        const char *row = m + ((size_t)i * n + i + 1) * size;
+        const char *col = m + ((size_t)(i + 1) * n + i) * size;
+        if (!checkSymBlockTyped(t, row, n, col, n, 1, n - i - 1, cmp)) {
+            local_sym = 0;
         }
     }
     // Reduce the local symmetry checks to a global symmetry check
@@ -56,54 +46,145 @@ int checkSymMPI(float *matrix, int n, int rank, int num_processor) {
     return global_sym;
 }
 
-// Transposition using MPI Scatter/Gather in a row-to-column fashion
-void matTransposeMPI(float *matrix, float *transposed, int n, int rank, int num_processors) {
+// Transposition using MPI Scatter/Gather in a row-to-column fashion: the block of rows of rank r is column block r of
+// the transpose, so a single MPI_Gather whose receive type lays the data out column-wise puts every element straight
+// in its final place. Every rank sends contiguous data (the tree algorithms forward it through intermediate ranks,
+// which only know the send type), only the receive type on rank 0 is strided:
+//  - one thread: local_block is sent as is and every row of it becomes a column (n elements n apart, resized to one
+//    element so that consecutive rows go to consecutive columns and the rows of rank r start at column r * local_rows)
+//  - more threads: the threads of the rank transpose local_block with the tile kernels first and the result is one
+//    column block (n rows of local_rows elements, resized to local_rows elements for the same reason)
+void matTransposeMPI(void *matrix, void *transposed, int n, DType dtype, int num_processors, int n_threads) {
+    const TypedKernelTable *t = typedKernels(dtype);
+    size_t size = (size_t)t->size;
+    MPI_Datatype type = dtypeMPI(dtype);
+
     // Every processor will handle n/num_processors rows
     int local_rows_number = n / num_processors;
-    float *local_block = (float *)malloc(local_rows_number * n * sizeof(float));
+    char *local_block = (char *)malloc((size_t)local_rows_number * n * size);
+    char *local_transposed = NULL;
 
-    // Create a buffer for sending columns and receiving rows
-    float *send_row_buffer = (float *)malloc(local_rows_number * sizeof(float));
-    float *recv_row_buffer = NULL;
-    if (rank == 0) {
-        recv_row_buffer = (float *)malloc(n * sizeof(float));
+    MPI_Datatype strided, recv_type;
+    if (n_threads > 1) {
+        local_transposed = (char *)malloc((size_t)n * local_rows_number * size);
+        MPI_Type_vector(n, local_rows_number, n, type, &strided);
+        MPI_Type_create_resized(strided, 0, (MPI_Aint)(local_rows_number * size), &recv_type);
+    } else {
+        MPI_Type_vector(n, 1, n, type, &strided);
+        MPI_Type_create_resized(strided, 0, (MPI_Aint)size, &recv_type);
     }
+    MPI_Type_free(&strided);
+    MPI_Type_commit(&recv_type);
 
     // Scatter the matrix in blocks to all processes
-    MPI_Scatter(matrix, local_rows_number * n, MPI_FLOAT, local_block, local_rows_number * n, MPI_FLOAT, 0, MPI_COMM_WORLD);
-    for (int col = 0; col < n; col++) {
-        for (int row = 0; row < local_rows_number; row++) {
-            send_row_buffer[row] = local_block[row * n + col];
-        }
+    MPI_Scatter(matrix, local_rows_number * n, type, local_block, local_rows_number * n, type, 0, MPI_COMM_WORLD);
+    if (n_threads > 1) {
+        transposeBlockTypedOMP(t, local_block, n, local_transposed, local_rows_number, local_rows_number, n, n_threads);
+        MPI_Gather(local_transposed, local_rows_number * n, type, transposed, 1, recv_type, 0, MPI_COMM_WORLD);
+    } else {
+        MPI_Gather(local_block, local_rows_number * n, type, transposed, local_rows_number, recv_type, 0, MPI_COMM_WORLD);
+    }
 
-        // Gather the transposed rows from all processes
-        MPI_Gather(send_row_buffer, local_rows_number, MPI_FLOAT, recv_row_buffer, local_rows_number, MPI_FLOAT, 0, MPI_COMM_WORLD);
-        // Combine the transposed rows back into the matrix (only on the main thread)
-        if (rank == 0) {
-            for (int row_main = 0; row_main < n; row_main++) {
-                transposed[col * n + row_main] = recv_row_buffer[row_main];
-            }
+    MPI_Type_free(&recv_type);
+    free(local_transposed);
+    free(local_block);
+}
+
+// Pipelined variant of matTransposeMPI: the block of rows of every rank is split in chunks (of rows), scattered with
+// MPI_Iscatterv and gathered with MPI_Igatherv chunk by chunk. Up to depth scatters are in flight ahead of the chunk
+// being transposed, and the gather of a chunk is posted as soon as it is transposed, so the communication of the
+// other chunks overlaps with the local transposes. The gather of chunk c uses the column block receive type of its
+// rows (as in matTransposeMPI, only the receive side on rank 0 is strided); the outstanding requests are tested after
+// every chunk so that they progress without an asynchronous progress thread. The count and displacement arrays of
+// a nonblocking collective can't change until it completes, so every chunk has its own, kept until the final wait
+void matTransposePipelinedMPI(void *matrix, void *transposed, int n, DType dtype, int num_processors, int n_threads, int chunks, int depth) {
+    const TypedKernelTable *t = typedKernels(dtype);
+    size_t size = (size_t)t->size;
+    MPI_Datatype type = dtypeMPI(dtype);
+
+    int local_rows_number = n / num_processors;
+    if (chunks > local_rows_number) chunks = local_rows_number;
+    char *local_block = (char *)malloc((size_t)local_rows_number * n * size);
+    // Chunk c (rows [start_c, start_c+1) of the local block) transposed: n x rows_c packed, one after the other
+    char *local_transposed = (char *)malloc((size_t)n * local_rows_number * size);
+    MPI_Request *scatters = (MPI_Request *)malloc(2 * chunks * sizeof(MPI_Request));
+    MPI_Request *gathers = scatters + chunks;
+    MPI_Datatype *recv_types = (MPI_Datatype *)malloc(chunks * sizeof(MPI_Datatype));
+    // Per chunk c: scatter counts and displacements, gather displacements (num_processors entries each), then ones
+    int *counts = (int *)malloc(((size_t)3 * chunks + 1) * num_processors * sizeof(int));
+    int *scatter_displs = counts + (size_t)chunks * num_processors;
+    int *gather_displs = scatter_displs + (size_t)chunks * num_processors;
+    int *ones = gather_displs + (size_t)chunks * num_processors;
+
+    for (int c = 0; c < chunks; c++) {
+        int rows = blockStart(local_rows_number, chunks, c + 1) - blockStart(local_rows_number, chunks, c);
+        MPI_Datatype strided;
+        MPI_Type_vector(n, rows, n, type, &strided);
+        MPI_Type_create_resized(strided, 0, (MPI_Aint)size, &recv_types[c]);
+        MPI_Type_free(&strided);
+        MPI_Type_commit(&recv_types[c]);
+
+        // Chunk c of every rank: rows_c * n contiguous elements from its rows of the matrix, column block
+        // r * local_rows + start_c of the transpose (displacements in elements)
+        int start = blockStart(local_rows_number, chunks, c);
+        for (int r = 0; r < num_processors; r++) {
+            counts[c * num_processors + r] = rows * n;
+            scatter_displs[c * num_processors + r] = (r * local_rows_number + start) * n;
+            gather_displs[c * num_processors + r] = r * local_rows_number + start;
         }
     }
+    for (int r = 0; r < num_processors; r++) ones[r] = 1;
 
-    free(send_row_buffer);
-    free(local_block);
+    for (int c = 0; c < chunks && c < depth; c++) {
+        int start = blockStart(local_rows_number, chunks, c);
+        int rows = blockStart(local_rows_number, chunks, c + 1) - start;
+        MPI_Iscatterv(matrix, counts + c * num_processors, scatter_displs + c * num_processors, type, local_block + (size_t)start * n * size, rows * n, type, 0, MPI_COMM_WORLD, &scatters[c]);
+    }
 
-    if (rank == 0) {
-        free(recv_row_buffer);
+    for (int c = 0; c < chunks; c++) {
+        int start = blockStart(local_rows_number, chunks, c);
+        int rows = blockStart(local_rows_number, chunks, c + 1) - start;
+        MPI_Wait(&scatters[c], MPI_STATUS_IGNORE);
+
+        // Keep depth scatters in flight
+        int next = c + depth;
+        if (next < chunks) {
+            int next_start = blockStart(local_rows_number, chunks, next);
+            int next_rows = blockStart(local_rows_number, chunks, next + 1) - next_start;
+            MPI_Iscatterv(matrix, counts + next * num_processors, scatter_displs + next * num_processors, type, local_block + (size_t)next_start * n * size, next_rows * n, type, 0, MPI_COMM_WORLD,
+                          &scatters[next]);
+        }
+
+        char *chunk_transposed = local_transposed + (size_t)start * n * size;
+        transposeBlockTypedOMP(t, local_block + (size_t)start * n * size, n, chunk_transposed, rows, rows, n, n_threads);
+
+        MPI_Igatherv(chunk_transposed, rows * n, type, transposed, ones, gather_displs + c * num_processors, recv_types[c], 0, MPI_COMM_WORLD, &gathers[c]);
+
+        int done;
+        MPI_Testall(c + 1, gathers, &done, MPI_STATUSES_IGNORE);
     }
+    MPI_Waitall(chunks, gathers, MPI_STATUSES_IGNORE);
+
+    for (int c = 0; c < chunks; c++) MPI_Type_free(&recv_types[c]);
+    free(counts);
+    free(recv_types);
+    free(scatters);
+    free(local_transposed);
+    free(local_block);
 }
 
 int main(int argc, char *argv[]) {
-    MPI_Init(&argc, &argv);
+    // Only the main thread of a rank calls MPI, the OpenMP threads work on local data in between
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
 
     int rank, num_processors;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &num_processors);
 
     // Input validation
-    if (rank == 0 && argc != 3) {
-        printf("Usage: mpirun -np <n_processors> %s <n> <iterations>\n", argv[0]);
+    if (rank == 0 && (argc < 3 || argc > 7)) {
+        printf("Usage: mpirun -np <n_processors> %s <n> <iterations> [dtype] [n_threads] [chunks] [depth]\n", argv[0]);
         MPI_Abort(MPI_COMM_WORLD, 1);
     }
 
@@ -118,33 +199,56 @@ int main(int argc, char *argv[]) {
         if (rank == 0) printf("Number of iterations must be 1 <= iterations <= 50\n");
         MPI_Abort(MPI_COMM_WORLD, 1);
     }
+    int dtype = argc >= 4 ? dtypeFromString(argv[3]) : DTYPE_FLOAT;
+    int n_threads = argc >= 5 ? atoi(argv[4]) : 1;
+    // Pipelined transposition: chunks per block of rows (1 disables it) and scatters in flight ahead of the transposed chunk
+    int chunks = argc >= 6 ? atoi(argv[5]) : 1;
+    int depth = argc == 7 ? atoi(argv[6]) : 2;
+    if (dtype < 0) {
+        if (rank == 0) printf("Element type must be one of float, double, int8, uint8, int16, int32, complex64, complex128\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (n_threads < 1) {
+        if (rank == 0) printf("Number of threads must be greater than 0\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    // The OpenMP teams between the MPI calls need at least MPI_THREAD_FUNNELED, otherwise every rank runs serially
+    if (provided < MPI_THREAD_FUNNELED && n_threads > 1) {
+        if (rank == 0) printf("The MPI library does not provide MPI_THREAD_FUNNELED, using 1 thread per rank\n");
+        n_threads = 1;
+    }
     if (n < num_processors) {
         if (rank == 0) printf("Matrix n must be greater than or equal to the number of processors\n");
         MPI_Abort(MPI_COMM_WORLD, 1);
     }
+    if (chunks < 1 || depth < 1) {
+        if (rank == 0) printf("Number of chunks and pipeline depth must be greater than 0\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
 
-    // Instantiation of the matrix and its transpose
-    float *matrix = NULL;
-    float *transposed = NULL;
+    // Instantiation of the matrix and its transpose (only on rank 0)
+    // Rows are not padded (ld == n), so the buffers can be used as flat n * n arrays
+    TypedMatrix matrix = {0};
+    TypedMatrix transposed = {0};
 
     if (rank == 0) {
-        matrix = (float *)malloc(n * n * sizeof(float));
-        transposed = (float *)malloc(n * n * sizeof(float));
+        typedMatrixAllocPacked(&matrix, n, n, (DType)dtype);
+        typedMatrixAllocPacked(&transposed, n, n, (DType)dtype);
     }
 
     double start_time, end_time;
-    double total_s, total_t = 0.0;
+    double total_s = 0.0, total_t = 0.0, total_p = 0.0;
     MPI_Barrier(MPI_COMM_WORLD);
 
     for (int iter = 0; iter < iterations; iter++) {
         if (rank == 0) {
-            initializeMatrix(matrix, n);
+            typedMatrixRandom(&matrix);
         }
 
         // Symmetry check performance evaluation
         MPI_Barrier(MPI_COMM_WORLD);
         start_time = MPI_Wtime();
-        checkSymMPI(matrix, n, rank, num_processors);
+        checkSymMPI(matrix.data, n, (DType)dtype, rank, num_processors, n_threads);
         MPI_Barrier(MPI_COMM_WORLD);
         end_time = MPI_Wtime();
         if (rank == 0) total_s += (end_time - start_time);
@@ -152,22 +256,44 @@ int main(int argc, char *argv[]) {
         // Transposition performance evaluation
         MPI_Barrier(MPI_COMM_WORLD);
         start_time = MPI_Wtime();
-        matTransposeMPI(matrix, transposed, n, rank, num_processors);
+        matTransposeMPI(matrix.data, transposed.data, n, (DType)dtype, num_processors, n_threads);
         MPI_Barrier(MPI_COMM_WORLD);
         end_time = MPI_Wtime();
 
         if (rank == 0) {
             total_t += (end_time - start_time);
-            int success = checkTranspose(matrix, transposed, n);
+            int success = typedCheckTranspose(&matrix, &transposed);
             printf("%s", success ? "" : "Matrix transposition failed\n");
         }
+
+        // Pipelined transposition performance evaluation
+        if (chunks > 1) {
+            if (rank == 0) typedMatrixZero(&transposed);
+            MPI_Barrier(MPI_COMM_WORLD);
+            start_time = MPI_Wtime();
+            matTransposePipelinedMPI(matrix.data, transposed.data, n, (DType)dtype, num_processors, n_threads, chunks, depth);
+            MPI_Barrier(MPI_COMM_WORLD);
+            end_time = MPI_Wtime();
+
+            if (rank == 0) {
+                total_p += (end_time - start_time);
+                int success = typedCheckTranspose(&matrix, &transposed);
+                printf("%s", success ? "" : "Pipelined matrix transposition failed\n");
+            }
+        }
     }
 
     if (rank == 0) {
-        printf("Average symmetry chck time (size: %d, np: %d, iterations: %d): %f ms\n", n, num_processors, iterations, (total_s / iterations) * 1000);
-        printf("Average transposition time (size: %d, np: %d, iterations: %d): %f ms\n", n, num_processors, iterations, (total_t / iterations) * 1000);
-        free(matrix);
-        free(transposed);
+        printf("Average symmetry chck time (size: %d, np: %d, threads: %d, iterations: %d, type: %s): %f ms\n", n, num_processors, n_threads, iterations,
+               dtypeInfo[dtype].name, (total_s / iterations) * 1000);
+        printf("Average transposition time (size: %d, np: %d, threads: %d, iterations: %d, type: %s): %f ms\n", n, num_processors, n_threads, iterations,
+               dtypeInfo[dtype].name, (total_t / iterations) * 1000);
+        if (chunks > 1) {
+            printf("Average pipelined transposition time (size: %d, np: %d, threads: %d, chunks: %d, depth: %d, iterations: %d, type: %s): %f ms\n", n,
+                   num_processors, n_threads, chunks, depth, iterations, dtypeInfo[dtype].name, (total_p / iterations) * 1000);
+        }
+        typedMatrixFree(&matrix);
+        typedMatrixFree(&transposed);
     }
 
     MPI_Finalize();
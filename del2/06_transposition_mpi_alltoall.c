@@ -0,0 +1,346 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "../common/distributed.h"
+
+// Row-block distributed transposition: rank r owns rows [start_r, start_r+1) of the matrix and ends up with the same
+// rows of the transpose, so neither the matrix nor the transpose is ever assembled on one rank (O(n^2/p) memory each).
+// Block (r, q) of the matrix, rows of r and columns of q, becomes block (q, r) of the transpose: every rank transposes
+// its row block locally, exchanges the p sub-blocks with one MPI_Alltoallv and copies what it receives into place.
+// The one-sided variant skips the receive side: every rank exposes its rows of the transpose in an MPI window and
+// puts its transposed sub-blocks straight into place in the windows of the others (see matTransposeRMA).
+// The symmetry check on the same distribution only moves the blocks below the diagonal, each of them once (see
+// checkSymMirror).
+
+typedef struct {
+    int *send_counts, *send_displs;
+    int *recv_counts, *recv_displs;
+    char *send, *recv; // local_rows x n elements each
+} AlltoallBuffers;
+
+// Counts and displacements (in elements) of the exchange for this rank, buffers allocated once for all iterations
+int alltoallInit(AlltoallBuffers *b, int n, size_t size, int rank, int num_processors) {
+    int first_row = blockStart(n, num_processors, rank);
+    int local_rows = blockStart(n, num_processors, rank + 1) - first_row;
+
+    b->send_counts = (int *)malloc(4 * num_processors * sizeof(int));
+    b->send_displs = b->send_counts + num_processors;
+    b->recv_counts = b->send_displs + num_processors;
+    b->recv_displs = b->recv_counts + num_processors;
+    b->send = (char *)malloc((size_t)local_rows * n * size);
+    b->recv = (char *)malloc((size_t)local_rows * n * size);
+    if (b->send_counts == NULL || b->send == NULL || b->recv == NULL) return 0;
+
+    for (int q = 0; q < num_processors; q++) {
+        int start = blockStart(n, num_processors, q);
+        int rows = blockStart(n, num_processors, q + 1) - start;
+        // To q: rows [start, start + rows) of the transposed local block, contiguous once the whole block is transposed
+        b->send_counts[q] = rows * local_rows;
+        b->send_displs[q] = start * local_rows;
+        // From q: its columns of our rows of the transpose, a local_rows x rows block packed with ld rows
+        b->recv_counts[q] = local_rows * rows;
+        b->recv_displs[q] = local_rows * start;
+    }
+    return 1;
+}
+
+void alltoallFree(AlltoallBuffers *b) {
+    free(b->send_counts);
+    free(b->send);
+    free(b->recv);
+}
+
+// local: rows first_row .. of the matrix (local_rows x n), local_transposed: the same rows of the transpose
+void matTransposeAlltoall(const TypedMatrix *local, TypedMatrix *local_transposed, AlltoallBuffers *b, int num_processors, int n_threads) {
+    const TypedKernelTable *t = typedKernels(local->dtype);
+    size_t size = (size_t)t->size;
+    int n = local->cols;
+    int local_rows = local->rows;
+
+    // Local transpose (n x local_rows): the sub-block for rank q is the contiguous rows of q
+    transposeBlockTypedOMP(t, local->data, local->ld, b->send, local_rows, local_rows, n, n_threads);
+
+    MPI_Alltoallv(b->send, b->send_counts, b->send_displs, dtypeMPI(local->dtype), b->recv, b->recv_counts, b->recv_displs, dtypeMPI(local->dtype),
+                  MPI_COMM_WORLD);
+
+    // Local reorder: the block from rank q goes to columns [start_q, start_q+1) of our rows
+#pragma omp parallel for collapse(2) num_threads(n_threads) if (n_threads > 1)
+    for (int q = 0; q < num_processors; q++) {
+        for (int i = 0; i < local_rows; i++) {
+            int start = blockStart(n, num_processors, q);
+            int rows = blockStart(n, num_processors, q + 1) - start;
+            memcpy(typedAt(local_transposed, i, start), b->recv + ((size_t)b->recv_displs[q] + (size_t)i * rows) * size, (size_t)rows * size);
+        }
+    }
+}
+
+// Window over the rows of the transpose of this rank and, for every target rank q, the datatype of our sub-block in
+// its rows: rows_q rows of local_rows elements, n apart (displacements in elements)
+typedef struct {
+    MPI_Win win;
+    MPI_Datatype *target_types;
+} RmaPlan;
+
+int rmaInit(RmaPlan *r, TypedMatrix *local_transposed, int num_processors) {
+    int n = local_transposed->cols;
+    int local_rows = local_transposed->rows;
+    int size = dtypeInfo[local_transposed->dtype].size;
+    MPI_Datatype type = dtypeMPI(local_transposed->dtype);
+
+    r->target_types = (MPI_Datatype *)malloc(num_processors * sizeof(MPI_Datatype));
+    if (r->target_types == NULL) return 0;
+    for (int q = 0; q < num_processors; q++) {
+        int rows = blockStart(n, num_processors, q + 1) - blockStart(n, num_processors, q);
+        MPI_Type_vector(rows, local_rows, n, type, &r->target_types[q]);
+        MPI_Type_commit(&r->target_types[q]);
+    }
+    MPI_Win_create(local_transposed->data, (MPI_Aint)local_rows * n * size, size, MPI_INFO_NULL, MPI_COMM_WORLD, &r->win);
+    return 1;
+}
+
+void rmaFree(RmaPlan *r, int num_processors) {
+    MPI_Win_free(&r->win);
+    for (int q = 0; q < num_processors; q++) MPI_Type_free(&r->target_types[q]);
+    free(r->target_types);
+}
+
+// One-sided transposition: the local block is transposed into the send buffer as in matTransposeAlltoall, then the
+// rows of rank q (a contiguous rows_q x local_rows block) are put at column first_row of its rows of the transpose.
+// One fence epoch: no matching receives, no reorder on the target and no rendezvous handshake per message
+void matTransposeRMA(const TypedMatrix *local, RmaPlan *r, AlltoallBuffers *b, int rank, int num_processors, int n_threads) {
+    const TypedKernelTable *t = typedKernels(local->dtype);
+    size_t size = (size_t)t->size;
+    int n = local->cols;
+    int local_rows = local->rows;
+    int first_row = blockStart(n, num_processors, rank);
+
+    transposeBlockTypedOMP(t, local->data, local->ld, b->send, local_rows, local_rows, n, n_threads);
+
+    // No RMA operation precedes this epoch. NOSTORE can't be asserted: the window memory was written with local
+    // stores (the Alltoall reorder, the reset in main) since the last fence
+    MPI_Win_fence(MPI_MODE_NOPRECEDE, r->win);
+    for (int k = 0; k < num_processors; k++) {
+        // Staggered targets, so that the ranks don't all write to the same window at first
+        int q = (rank + k) % num_processors;
+        MPI_Put(b->send + (size_t)b->send_displs[q] * size, b->send_counts[q], dtypeMPI(local->dtype), q, first_row, 1, r->target_types[q], r->win);
+    }
+    MPI_Win_fence(MPI_MODE_NOSUCCEED, r->win);
+}
+
+// a (rows x cols, lda) against the transpose of b (cols x rows, ldb), blocks of rows shared by the threads
+int checkMirrorBlock(const TypedKernelTable *t, const char *a, int lda, const char *b, int ldb, int rows, int cols, FloatCompare cmp, int n_threads) {
+    size_t size = (size_t)t->size;
+    int sym = 1;
+#pragma omp parallel for schedule(static) num_threads(n_threads) reduction(&& : sym) if (n_threads > 1)
+    for (int i = 0; i < rows; i += TYPED_PARALLEL_BLOCK) {
+        int h = i + TYPED_PARALLEL_BLOCK > rows ? rows - i : TYPED_PARALLEL_BLOCK;
+        if (!checkSymBlockTyped(t, a + (size_t)i * lda * size, lda, b + (size_t)i * size, ldb, h, cols, cmp)) sym = 0;
+    }
+    return sym;
+}
+
+// Symmetry check on the row-block distribution: block (r, s) has to be the transpose of block (s, r). The diagonal
+// block is checked by its own rank; for the other pairs, in round d rank r receives block (r + d, r) from rank r + d
+// and checks it against its block (r, r + d), while it sends its block (r, r - d) to rank r - d (a strided datatype,
+// no packing). After floor(p/2) rounds every pair has been checked exactly once by one of its two ranks and every
+// rank has checked about as many blocks as the others (with an even p, the pairs (r, r + p/2) of the last round are
+// checked by the lower half only), and every element has crossed the network at most once: O(n^2) traffic instead
+// of the O(p n^2) of a broadcast. The partial results are combined with MPI_Iallreduce overlapped with the next
+// round; every rank sees the same reduced value at the same point, so they all stop at the first asymmetric round
+int checkSymMirror(const TypedMatrix *local, int first_row, int rank, int num_processors, int n_threads, char *buffer) {
+    const TypedKernelTable *t = typedKernels(local->dtype);
+    const FloatCompare cmp = symmetryCompare();
+    MPI_Datatype type = dtypeMPI(local->dtype);
+    int n = local->cols;
+    int rows = local->rows;
+    int local_sym = 1;
+
+    // Diagonal block: row i right of the diagonal against column i below it (rows get shorter going down)
+#pragma omp parallel for schedule(dynamic, 16) num_threads(n_threads) reduction(&& : local_sym)
+    for (int i = 0; i < rows - 1; i++) {
+        const char *row = (const char *)typedAt(local, i, first_row + i + 1);
+        const char *col = (const char *)typedAt(local, i + 1, first_row + i);
+        if (!checkSymBlockTyped(t, row, local->ld, col, local->ld, 1, rows - i - 1, cmp)) local_sym = 0;
+    }
+
+    int sent = local_sym, reduced = 1;
+    MPI_Request reduce;
+    MPI_Iallreduce(&sent, &reduced, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD, &reduce);
+
+    for (int d = 1; d <= num_processors / 2; d++) {
+        int from = (rank + d) % num_processors;
+        int to = (rank - d + num_processors) % num_processors;
+        int last_even = 2 * d == num_processors;
+        int receive = !(last_even && rank >= num_processors / 2);
+        int send = !(last_even && rank < num_processors / 2);
+        int from_start = blockStart(n, num_processors, from);
+        int from_rows = blockStart(n, num_processors, from + 1) - from_start;
+        int to_start = blockStart(n, num_processors, to);
+        int to_rows = blockStart(n, num_processors, to + 1) - to_start;
+
+        // Block (rank, to): our rows, the columns of to
+        MPI_Datatype block;
+        MPI_Type_vector(rows, to_rows, local->ld, type, &block);
+        MPI_Type_commit(&block);
+        MPI_Sendrecv(typedAt(local, 0, to_start), send ? 1 : 0, block, send ? to : MPI_PROC_NULL, 0, buffer, receive ? from_rows * rows : 0, type,
+                     receive ? from : MPI_PROC_NULL, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        MPI_Type_free(&block);
+
+        // Block (from, rank) arrived as from_rows x rows: check it against our block (rank, from) unless already asymmetric
+        if (receive && local_sym) {
+            local_sym = checkMirrorBlock(t, (const char *)typedAt(local, 0, from_start), local->ld, buffer, rows, rows, from_rows, cmp, n_threads);
+        }
+
+        // Result of the previous round (identical on every rank), then this round's
+        MPI_Wait(&reduce, MPI_STATUS_IGNORE);
+        if (!reduced) return 0;
+        sent = local_sym;
+        MPI_Iallreduce(&sent, &reduced, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD, &reduce);
+    }
+    MPI_Wait(&reduce, MPI_STATUS_IGNORE);
+    return reduced;
+}
+
+int main(int argc, char *argv[]) {
+    // Only the main thread of a rank calls MPI, the OpenMP threads work on local data in between
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+
+    int rank, num_processors;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &num_processors);
+
+    // Input validation
+    if (argc < 3 || argc > 5) {
+        if (rank == 0) printf("Usage: mpirun -np <n_processors> %s <n> <iterations> [dtype] [n_threads]\n", argv[0]);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    int e = atoi(argv[1]);
+    int n = 1 << e;
+    int iterations = atoi(argv[2]);
+    if (e < 4 || e > 12) {
+        if (rank == 0) printf("Matrix n must be between 16 and 4096 (4 <= exponent <= 12)\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (iterations < 1 || iterations > 50) {
+        if (rank == 0) printf("Number of iterations must be 1 <= iterations <= 50\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    int dtype = argc >= 4 ? dtypeFromString(argv[3]) : DTYPE_FLOAT;
+    int n_threads = argc == 5 ? atoi(argv[4]) : 1;
+    if (dtype < 0) {
+        if (rank == 0) printf("Element type must be one of float, double, int8, uint8, int16, int32, complex64, complex128\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (n_threads < 1) {
+        if (rank == 0) printf("Number of threads must be greater than 0\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    // The OpenMP teams between the MPI calls need at least MPI_THREAD_FUNNELED, otherwise every rank runs serially
+    if (provided < MPI_THREAD_FUNNELED && n_threads > 1) {
+        if (rank == 0) printf("The MPI library does not provide MPI_THREAD_FUNNELED, using 1 thread per rank\n");
+        n_threads = 1;
+    }
+    if (n < num_processors) {
+        if (rank == 0) printf("Matrix n must be greater than or equal to the number of processors\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    // Every rank owns a block of rows of the matrix and of its transpose (the blocks differ by at most one row
+    // when the number of processors does not divide n)
+    int first_row = blockStart(n, num_processors, rank);
+    int local_rows = blockStart(n, num_processors, rank + 1) - first_row;
+    TypedMatrix local = {0};
+    TypedMatrix local_transposed = {0};
+    TypedMatrix symmetric = {0};
+    AlltoallBuffers buffers;
+    RmaPlan rma;
+    // Mirror blocks received by the symmetry check: at most (n/p + 1)^2 elements
+    int max_rows = n / num_processors + 1;
+    char *mirror = (char *)malloc((size_t)max_rows * max_rows * dtypeInfo[dtype].size);
+    if (!typedMatrixAllocPacked(&local, local_rows, n, (DType)dtype) || !typedMatrixAllocPacked(&local_transposed, local_rows, n, (DType)dtype) ||
+        !typedMatrixAllocPacked(&symmetric, local_rows, n, (DType)dtype) || mirror == NULL ||
+        !alltoallInit(&buffers, n, (size_t)dtypeInfo[dtype].size, rank, num_processors) || !rmaInit(&rma, &local_transposed, num_processors)) {
+        printf("Memory allocation failed on rank %d\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    typedFillRows(&local, first_row);
+    typedFillRowsSymmetric(&symmetric, first_row);
+
+    double start_time, end_time;
+    double total_s = 0.0, total_e = 0.0, total_t = 0.0, total_r = 0.0;
+    int local_success = 1, success = 1;
+
+    for (int iter = 0; iter < iterations; iter++) {
+        // Symmetry check performance evaluation (on a symmetric matrix, so that every block is checked)
+        MPI_Barrier(MPI_COMM_WORLD);
+        start_time = MPI_Wtime();
+        int sym = checkSymMirror(&symmetric, first_row, rank, num_processors, n_threads, mirror);
+        MPI_Barrier(MPI_COMM_WORLD);
+        end_time = MPI_Wtime();
+        total_s += (end_time - start_time);
+        if (rank == 0) printf("%s", sym ? "" : "Symmetry check failed\n");
+
+        // Same check on the asymmetric matrix, where all the ranks stop after the round that finds the first mismatch
+        MPI_Barrier(MPI_COMM_WORLD);
+        start_time = MPI_Wtime();
+        int asym = checkSymMirror(&local, first_row, rank, num_processors, n_threads, mirror);
+        MPI_Barrier(MPI_COMM_WORLD);
+        end_time = MPI_Wtime();
+        total_e += (end_time - start_time);
+        if (rank == 0) printf("%s", asym ? "Early-exit symmetry check failed\n" : "");
+
+        memset(local_transposed.data, 0, (size_t)local_rows * n * dtypeInfo[dtype].size);
+
+        // Transposition performance evaluation
+        MPI_Barrier(MPI_COMM_WORLD);
+        start_time = MPI_Wtime();
+        matTransposeAlltoall(&local, &local_transposed, &buffers, num_processors, n_threads);
+        MPI_Barrier(MPI_COMM_WORLD);
+        end_time = MPI_Wtime();
+        total_t += (end_time - start_time);
+
+        // Every rank checks its own rows of the transpose
+        local_success = typedCheckTransposedRows(&local_transposed, first_row);
+        MPI_Allreduce(&local_success, &success, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+        if (rank == 0) printf("%s", success ? "" : "Matrix transposition failed\n");
+
+        memset(local_transposed.data, 0, (size_t)local_rows * n * dtypeInfo[dtype].size);
+
+        // One-sided transposition performance evaluation (into the same rows, exposed by the window)
+        MPI_Barrier(MPI_COMM_WORLD);
+        start_time = MPI_Wtime();
+        matTransposeRMA(&local, &rma, &buffers, rank, num_processors, n_threads);
+        MPI_Barrier(MPI_COMM_WORLD);
+        end_time = MPI_Wtime();
+        total_r += (end_time - start_time);
+
+        local_success = typedCheckTransposedRows(&local_transposed, first_row);
+        MPI_Allreduce(&local_success, &success, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+        if (rank == 0) printf("%s", success ? "" : "RMA matrix transposition failed\n");
+    }
+
+    if (rank == 0) {
+        printf("Average mirror symmetry chck time (size: %d, np: %d, threads: %d, iterations: %d, type: %s): %f ms\n", n, num_processors, n_threads,
+               iterations, dtypeInfo[dtype].name, (total_s / iterations) * 1000);
+        printf("Average early-exit symmetry chck time (size: %d, np: %d, threads: %d, iterations: %d, type: %s): %f ms\n", n, num_processors,
+               n_threads, iterations, dtypeInfo[dtype].name, (total_e / iterations) * 1000);
+        printf("Average alltoall transposition time (size: %d, np: %d, threads: %d, iterations: %d, type: %s): %f ms\n", n, num_processors, n_threads,
+               iterations, dtypeInfo[dtype].name, (total_t / iterations) * 1000);
+        printf("Average RMA transposition time (size: %d, np: %d, threads: %d, iterations: %d, type: %s): %f ms\n", n, num_processors, n_threads,
+               iterations, dtypeInfo[dtype].name, (total_r / iterations) * 1000);
+    }
+
+    rmaFree(&rma, num_processors);
+    alltoallFree(&buffers);
+    free(mirror);
+    typedMatrixFree(&symmetric);
+    typedMatrixFree(&local);
+    typedMatrixFree(&local_transposed);
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,289 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "../common/distributed.h"
+
+// Transposition of a matrix in a 2D block-cyclic layout (the ScaLAPACK one): on a Pr x Pc grid of processes, block
+// (I, J) of mb x nb elements lives on process (I mod Pr, J mod Pc). The transpose is returned in the same layout
+// with nb x mb blocks, so its block (J, I), the transpose of block (I, J), lives on process (J mod Pr, I mod Pc) and the
+// data never has to be redistributed to or from a 1D split. Local arrays are row major.
+//  - Square grid (Pr == Pc): the local array of process (p, q) transposed is exactly the local array of (q, p), so every
+//    process transposes its array as a whole and swaps it with its mirror in a single MPI_Sendrecv; the processes
+//    on the diagonal keep it (no communication at all).
+//  - Other grids: the blocks for every other process are packed (transposed) in one buffer, exchanged pairwise with
+//    MPI_Sendrecv (shift k: send to rank + k, receive from rank - k) and copied in place.
+
+typedef struct {
+    int n;
+    int mb, nb;   // blocks of the matrix, the transpose has nb x mb blocks
+    int Pr, Pc;   // process grid (ranks numbered row by row)
+    int p, q;     // coordinates of this rank
+    int rank, num_processors;
+    int *send_counts, *send_displs; // elements for rank r, in order of rank
+    int *recv_counts, *recv_displs;
+    char *send, *recv;
+} BlockCyclicPlan;
+
+static inline int blockExtent(int n, int block, int index) {
+    return (index + 1) * block > n ? n - index * block : block;
+}
+
+// Blocks (of size block, among the n indices) dealt to proc of procs with index % mod == rem, in increasing order
+int blocksOwned(int n, int block, int proc, int procs, int mod, int rem, int *list) {
+    int count = 0;
+    for (int index = proc; index * block < n; index += procs) {
+        if (index % mod == rem) list[count++] = index;
+    }
+    return count;
+}
+
+// Elements sent by process (sp, sq) to (dp, dq): the blocks (I, J) of (sp, sq) with J mod Pr == dp and I mod Pc == dq
+int exchangeCount(const BlockCyclicPlan *g, int sp, int sq, int dp, int dq, int *rows_list, int *cols_list) {
+    int rows = 0, cols = 0;
+    int row_blocks = blocksOwned(g->n, g->mb, sp, g->Pr, g->Pc, dq, rows_list);
+    int col_blocks = blocksOwned(g->n, g->nb, sq, g->Pc, g->Pr, dp, cols_list);
+    for (int k = 0; k < row_blocks; k++) rows += blockExtent(g->n, g->mb, rows_list[k]);
+    for (int k = 0; k < col_blocks; k++) cols += blockExtent(g->n, g->nb, cols_list[k]);
+    return rows * cols;
+}
+
+int blockCyclicInit(BlockCyclicPlan *g, int n, int mb, int nb, int Pr, int Pc, DType dtype) {
+    size_t size = (size_t)dtypeInfo[dtype].size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &g->rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &g->num_processors);
+    g->n = n;
+    g->mb = mb;
+    g->nb = nb;
+    g->Pr = Pr;
+    g->Pc = Pc;
+    g->p = g->rank / Pc;
+    g->q = g->rank % Pc;
+
+    int local = blockCyclicCount(n, mb, g->p, Pr) * blockCyclicCount(n, nb, g->q, Pc);
+    int local_transposed = blockCyclicCount(n, nb, g->p, Pr) * blockCyclicCount(n, mb, g->q, Pc);
+    int *rows_list = (int *)malloc((n / (mb < nb ? mb : nb) + 1) * sizeof(int));
+    int *cols_list = (int *)malloc((n / (mb < nb ? mb : nb) + 1) * sizeof(int));
+    g->send_counts = (int *)malloc(4 * g->num_processors * sizeof(int));
+    g->send = (char *)malloc((size_t)(local > 0 ? local : 1) * size);
+    g->recv = (char *)malloc((size_t)(local_transposed > 0 ? local_transposed : 1) * size);
+    if (rows_list == NULL || cols_list == NULL || g->send_counts == NULL || g->send == NULL || g->recv == NULL) return 0;
+    g->send_displs = g->send_counts + g->num_processors;
+    g->recv_counts = g->send_displs + g->num_processors;
+    g->recv_displs = g->recv_counts + g->num_processors;
+
+    int send_offset = 0, recv_offset = 0;
+    for (int r = 0; r < g->num_processors; r++) {
+        g->send_counts[r] = exchangeCount(g, g->p, g->q, r / Pc, r % Pc, rows_list, cols_list);
+        g->send_displs[r] = send_offset;
+        send_offset += g->send_counts[r];
+        g->recv_counts[r] = exchangeCount(g, r / Pc, r % Pc, g->p, g->q, rows_list, cols_list);
+        g->recv_displs[r] = recv_offset;
+        recv_offset += g->recv_counts[r];
+    }
+    free(rows_list);
+    free(cols_list);
+    return 1;
+}
+
+void blockCyclicFree(BlockCyclicPlan *g) {
+    free(g->send_counts);
+    free(g->send);
+    free(g->recv);
+}
+
+// Packs (transposed) the blocks of local for process (dp, dq) in buffer: row of blocks k of the list first, and in it
+// block (I, J) as a nb x mb packed block. Every row of blocks but the last global one is mb high, so the offset of
+// row k is k * mb * width and the rows of blocks can be packed in parallel
+void packBlocks(const BlockCyclicPlan *g, const TypedKernelTable *t, const TypedMatrix *local, int dp, int dq, char *buffer, int *rows_list,
+                int *cols_list, int n_threads) {
+    size_t size = (size_t)t->size;
+    int row_blocks = blocksOwned(g->n, g->mb, g->p, g->Pr, g->Pc, dq, rows_list);
+    int col_blocks = blocksOwned(g->n, g->nb, g->q, g->Pc, g->Pr, dp, cols_list);
+    int width = 0;
+    for (int l = 0; l < col_blocks; l++) width += blockExtent(g->n, g->nb, cols_list[l]);
+
+#pragma omp parallel for schedule(static) num_threads(n_threads) if (n_threads > 1)
+    for (int k = 0; k < row_blocks; k++) {
+        int I = rows_list[k];
+        int rows = blockExtent(g->n, g->mb, I);
+        char *dst = buffer + (size_t)k * g->mb * width * size;
+        for (int l = 0; l < col_blocks; l++) {
+            int J = cols_list[l];
+            int cols = blockExtent(g->n, g->nb, J);
+            t->transposeBlock(typedAt(local, I / g->Pr * g->mb, J / g->Pc * g->nb), local->ld, dst, rows, rows, cols);
+            dst += (size_t)rows * cols * size;
+        }
+    }
+}
+
+// Copies the blocks packed by process (sp, sq) for this rank in buffer to their place in local_transposed
+void unpackBlocks(const BlockCyclicPlan *g, TypedMatrix *local_transposed, int sp, int sq, const char *buffer, int *rows_list, int *cols_list,
+                  int n_threads) {
+    size_t size = (size_t)dtypeInfo[local_transposed->dtype].size;
+    int row_blocks = blocksOwned(g->n, g->mb, sp, g->Pr, g->Pc, g->q, rows_list);
+    int col_blocks = blocksOwned(g->n, g->nb, sq, g->Pc, g->Pr, g->p, cols_list);
+    int width = 0;
+    for (int l = 0; l < col_blocks; l++) width += blockExtent(g->n, g->nb, cols_list[l]);
+
+#pragma omp parallel for schedule(static) num_threads(n_threads) if (n_threads > 1)
+    for (int k = 0; k < row_blocks; k++) {
+        int I = rows_list[k];
+        int rows = blockExtent(g->n, g->mb, I);
+        const char *src = buffer + (size_t)k * g->mb * width * size;
+        for (int l = 0; l < col_blocks; l++) {
+            int J = cols_list[l];
+            int cols = blockExtent(g->n, g->nb, J);
+            // Block (J, I) of the transpose: cols x rows elements
+            for (int r = 0; r < cols; r++) {
+                memcpy(typedAt(local_transposed, J / g->Pr * g->nb + r, I / g->Pc * g->mb), src + (size_t)r * rows * size, (size_t)rows * size);
+            }
+            src += (size_t)rows * cols * size;
+        }
+    }
+}
+
+void matTransposeBlockCyclic(BlockCyclicPlan *g, const TypedMatrix *local, TypedMatrix *local_transposed, int n_threads) {
+    const TypedKernelTable *t = typedKernels(local->dtype);
+    MPI_Datatype type = dtypeMPI(local->dtype);
+
+    if (g->Pr == g->Pc) {
+        int mirror = g->q * g->Pc + g->p;
+        if (mirror == g->rank) {
+            // Diagonal: the local array transposed is already the local array of the transpose
+            transposeBlockTypedOMP(t, local->data, local->ld, local_transposed->data, local_transposed->ld, local->rows, local->cols, n_threads);
+            return;
+        }
+        transposeBlockTypedOMP(t, local->data, local->ld, g->send, local->rows, local->rows, local->cols, n_threads);
+        MPI_Sendrecv(g->send, local->rows * local->cols, type, mirror, 0, local_transposed->data, local_transposed->rows * local_transposed->cols, type,
+                     mirror, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        return;
+    }
+
+    int *rows_list = (int *)malloc((g->n / g->mb + 1) * sizeof(int));
+    int *cols_list = (int *)malloc((g->n / g->nb + 1) * sizeof(int));
+    for (int r = 0; r < g->num_processors; r++) {
+        if (g->send_counts[r] > 0) packBlocks(g, t, local, r / g->Pc, r % g->Pc, g->send + (size_t)g->send_displs[r] * t->size, rows_list, cols_list, n_threads);
+    }
+    for (int k = 0; k < g->num_processors; k++) {
+        int dest = (g->rank + k) % g->num_processors;
+        int source = (g->rank - k + g->num_processors) % g->num_processors;
+        const char *received = g->send + (size_t)g->send_displs[dest] * t->size;
+        if (k > 0) {
+            // Both sides derive the same counts, so empty exchanges are skipped on both ends
+            MPI_Sendrecv(g->send + (size_t)g->send_displs[dest] * t->size, g->send_counts[dest], type, g->send_counts[dest] > 0 ? dest : MPI_PROC_NULL, 0,
+                         g->recv + (size_t)g->recv_displs[source] * t->size, g->recv_counts[source], type,
+                         g->recv_counts[source] > 0 ? source : MPI_PROC_NULL, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            received = g->recv + (size_t)g->recv_displs[source] * t->size;
+        }
+        if (g->recv_counts[source] > 0) unpackBlocks(g, local_transposed, source / g->Pc, source % g->Pc, received, rows_list, cols_list, n_threads);
+    }
+    free(rows_list);
+    free(cols_list);
+}
+
+int main(int argc, char *argv[]) {
+    // Only the main thread of a rank calls MPI, the OpenMP threads work on local data in between
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+
+    int rank, num_processors;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &num_processors);
+
+    // Input validation
+    if (argc < 3 || argc > 8) {
+        if (rank == 0) printf("Usage: mpirun -np <n_processors> %s <n> <iterations> [dtype] [n_threads] [mb] [nb] [grid_rows]\n", argv[0]);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    int e = atoi(argv[1]);
+    int n = 1 << e;
+    int iterations = atoi(argv[2]);
+    if (e < 4 || e > 12) {
+        if (rank == 0) printf("Matrix n must be between 16 and 4096 (4 <= exponent <= 12)\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (iterations < 1 || iterations > 50) {
+        if (rank == 0) printf("Number of iterations must be 1 <= iterations <= 50\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    int dtype = argc >= 4 ? dtypeFromString(argv[3]) : DTYPE_FLOAT;
+    int n_threads = argc >= 5 ? atoi(argv[4]) : 1;
+    int mb = argc >= 6 ? atoi(argv[5]) : (n < 64 ? n : 64);
+    int nb = argc >= 7 ? atoi(argv[6]) : mb;
+    if (dtype < 0) {
+        if (rank == 0) printf("Element type must be one of float, double, int8, uint8, int16, int32, complex64, complex128\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (n_threads < 1) {
+        if (rank == 0) printf("Number of threads must be greater than 0\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    // The OpenMP teams between the MPI calls need at least MPI_THREAD_FUNNELED, otherwise every rank runs serially
+    if (provided < MPI_THREAD_FUNNELED && n_threads > 1) {
+        if (rank == 0) printf("The MPI library does not provide MPI_THREAD_FUNNELED, using 1 thread per rank\n");
+        n_threads = 1;
+    }
+    if (mb < 1 || nb < 1 || mb > n || nb > n) {
+        if (rank == 0) printf("Block sizes must be between 1 and n\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    // Grid as square as possible unless given: the largest divisor of the number of processors up to its square root
+    int grid_rows = 1;
+    for (int r = 1; r * r <= num_processors; r++) {
+        if (num_processors % r == 0) grid_rows = r;
+    }
+    if (argc == 8) grid_rows = atoi(argv[7]);
+    if (grid_rows < 1 || num_processors % grid_rows != 0) {
+        if (rank == 0) printf("Grid rows must divide the number of processors\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    int grid_cols = num_processors / grid_rows;
+
+    BlockCyclicPlan plan;
+    TypedMatrix local = {0};
+    TypedMatrix local_transposed = {0};
+    if (!blockCyclicInit(&plan, n, mb, nb, grid_rows, grid_cols, (DType)dtype) ||
+        !typedMatrixAllocPacked(&local, blockCyclicCount(n, mb, plan.p, grid_rows), blockCyclicCount(n, nb, plan.q, grid_cols), (DType)dtype) ||
+        !typedMatrixAllocPacked(&local_transposed, blockCyclicCount(n, nb, plan.p, grid_rows), blockCyclicCount(n, mb, plan.q, grid_cols), (DType)dtype)) {
+        printf("Memory allocation failed on rank %d\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    typedFillBlockCyclic(&local, mb, nb, plan.p, plan.q, grid_rows, grid_cols);
+
+    double start_time, end_time;
+    double total_t = 0.0;
+    int local_success = 1, success = 1;
+
+    for (int iter = 0; iter < iterations; iter++) {
+        typedMatrixZero(&local_transposed);
+
+        // Transposition performance evaluation
+        MPI_Barrier(MPI_COMM_WORLD);
+        start_time = MPI_Wtime();
+        matTransposeBlockCyclic(&plan, &local, &local_transposed, n_threads);
+        MPI_Barrier(MPI_COMM_WORLD);
+        end_time = MPI_Wtime();
+        total_t += (end_time - start_time);
+
+        // Every rank checks its own blocks of the transpose
+        local_success = typedCheckBlockCyclicTransposed(&local_transposed, nb, mb, plan.p, plan.q, grid_rows, grid_cols);
+        MPI_Allreduce(&local_success, &success, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+        if (rank == 0) printf("%s", success ? "" : "Matrix transposition failed\n");
+    }
+
+    if (rank == 0) {
+        printf("Average block-cyclic transposition time (size: %d, grid: %dx%d, blocks: %dx%d, threads: %d, iterations: %d, type: %s): %f ms\n", n,
+               grid_rows, grid_cols, mb, nb, n_threads, iterations, dtypeInfo[dtype].name, (total_t / iterations) * 1000);
+    }
+
+    blockCyclicFree(&plan);
+    typedMatrixFree(&local);
+    typedMatrixFree(&local_transposed);
+    MPI_Finalize();
+    return 0;
+}